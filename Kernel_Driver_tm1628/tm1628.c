@@ -1,8 +1,11 @@
 /*
- * tm1628.c - Platform driver for TM1628 LED display using GPIO bit-banging
+ * tm1628.c - Driver for the TM1628 LED display and key controller
  *
- * This driver uses three GPIOs (STB, DIO, CLK) to control the TM1628.
- * It obtains these GPIOs from the device tree.
+ * The chip's STB/CLK/DIO interface is a 3-wire, LSB-first SPI bus with STB
+ * as chip select. A node on the platform bus drives it by bit-banging three
+ * GPIOs (STB, DIO, CLK); a node under an SPI controller hands every strobe
+ * frame to the controller as one spi_sync() message instead. Everything
+ * above struct tm1628_bus is the same for both.
  *
  * DTS sample:
  * / {
@@ -11,14 +14,101 @@
  *         stb-gpio = <&gpio2 20 GPIO_ACTIVE_HIGH>;
  *         dio-gpio = <&gpio2 19 GPIO_ACTIVE_HIGH>;
  *         clk-gpio = <&gpio2 21 GPIO_ACTIVE_HIGH>;
+ *         clock-frequency = <500000>;           (optional, Hz, max 1 MHz)
+ *         titanmec,setup-time-ns = <100>;       (optional)
+ *         titanmec,hold-time-ns = <100>;        (optional)
+ *         titanmec,strobe-time-ns = <1000>;     (optional)
+ *         linux,keymap = <MATRIX_KEY(0, 0, KEY_UP)
+ *                         MATRIX_KEY(1, 0, KEY_DOWN)>;   (optional)
  *     };
  * };
  *
- * Class attributes are created under /sys/class/auxdisplay/ for:
+ * or, on SPI (spi-gpio works too, with the DIO line as its only data line):
+ * &spi3 {
+ *     tm1628@0 {
+ *         compatible = "titanmec,tm1628";
+ *         reg = <0>;
+ *         spi-max-frequency = <500000>;         (max 1 MHz)
+ *         spi-3wire;                            (mode is set by the driver)
+ *     };
+ * };
+ *
+ * linux,keymap uses rows K1-K2 and columns KS1-KS10; without it a 2x5
+ * digit keypad on KS1-KS5 is assumed. Each key scan clocks in only as many
+ * key bytes as the highest populated position needs.
+ *
+ * The bus timing is derived from those properties at probe time and the
+ * cost of a GPIO write is measured, so only the remainder of each datasheet
+ * interval is spent busy-waiting.
+ *
+ * Every matching DT node is an independent instance "tm1628-N" with its
+ * own kthread_worker, input device, character device and sysfs device.
+ * Attributes are created under /sys/class/auxdisplay/tm1628-N/ for:
  *   - brightness        (RW)
  *   - time              (RW)
+ *   - time_format       (RW, "24h" or "12h", PM shown by the last dot)
+ *   - date_format       (RW, "off", "dmy", "mdy" or "ymd"; when set the
+ *                        date replaces the time for 2 s out of every 10)
+ *   - tz_offset_min     (RW, minutes added to UTC for time mode)
  *   - display           (RW, for showing text or amount)
+ *   - number            (RW, "<value> [<decimals> [<flags>]]", a fixed-point
+ *                        number rendered without text; also an ioctl)
  *   - displaymode_config (RW, to select the display mode)
+ *   - max_fps           (RW, frame commit rate limit, 0 = unlimited)
+ *   - annunciators      (RW, per-grid SEG9+ bits, e.g. "0x100 0 0x200";
+ *                        bits claimed by a region are not changed)
+ *   - marquee           (RW, text scrolled across the grids, "" stops it)
+ *   - scroll_ms         (RW, marquee step time)
+ *   - marquee_loops     (RW, marquee passes, 0 = forever)
+ *   - label             (RO, DT "label" property or the device name)
+ *   - frames            (RO, frames that changed the display RAM)
+ *   - idle_display      (RW, "keep", "dim" or "off" in standby)
+ *
+ * DT child nodes describe display regions (see tm1628_regions_init()),
+ * each with its own region-<label>/ directory holding text, number and
+ * annunciators. Writing a region changes only its grids and annunciator
+ * bits; the composed frame goes out as one update.
+ *
+ * Writes only queue the new state and return. All bus work runs as work
+ * items on the instance's kthread_worker: frame commit, key scan, the
+ * time mode tick and the player's animation step, so the bus is only
+ * ever touched from one task. Whatever was posted since the last commit
+ * goes out as one transaction in datasheet order (mode, data, RAM,
+ * control), with the data command dropped when the chip already has it.
+ *
+ * The worker's policy, priority and CPUs come from the sched_policy,
+ * sched_priority and cpus module parameters, or per instance from DT:
+ *     titanmec,sched-policy = "fifo";      ("normal", "fifo" or "rr")
+ *     titanmec,sched-priority = <10>;      (RT priority, or nice for normal)
+ *     titanmec,cpus = <3>;                 (CPUs the worker may run on)
+ *
+ * /dev/tm1628-N takes raw 14-byte display RAM frames through write() or an
+ * mmap()ed framebuffer, and delivers key state changes through read() and
+ * poll(); see tm1628_ioctl.h. Frame sequences uploaded there, the marquee
+ * and the startup splash are stepped by an hrtimer-driven player, so they
+ * need no further syscalls once started.
+ *
+ * The splash starts as soon as the sysfs and input devices exist and any
+ * display write or key press ends it. It is the built-in digit count
+ * unless DT or the splash module parameter gives frames, or "none":
+ *     titanmec,splash = "HELLO@500", "8.8.8.8.8.8@300", "";
+ *     splash="HELLO@500,8.8.8.8.8.8@300,"
+ * A frame without "@ms" is shown for 1 s; the last one is held.
+ *
+ * With no sysfs or chardev writes and no key contact for the runtime PM
+ * autosuspend delay (power/autosuspend_delay_ms of the platform device,
+ * 60 s by default) the instance goes into standby: keys are scanned only
+ * every idle_scan_ms and the display is kept, dimmed or switched off as
+ * idle_display says. While off, frames are held and the newest one goes
+ * out on wakeup. Time mode and the player keep running but do not count
+ * as activity.
+ *
+ * Bus activity is counted in debugfs (tm1628/tm1628-N/stats) and traced
+ * through the tm1628 trace events, see tm1628_trace.h. Histograms of STB
+ * frame times and inter-byte gaps are kept in tm1628-N/latency; writing
+ * to it resets them. With atomic_bytes=N the bit-banged bus runs N bytes
+ * at a time with local interrupts off, bounding how long a loaded system
+ * can hold STB low.
  *
  * Supported display modes:
  *   "4x13"  → 4 grids, 13 segments (mode command 0x00)
@@ -26,6 +116,11 @@
  *   "6x11"  → 6 grids, 11 segments (mode command 0x02) [default]
  *   "7x10"  → 7 grids, 10 segments (mode command 0x03)
  *
+ * Text is rendered into one 16-bit pattern per grid (bit n = SEG(n+1))
+ * for as many grids as the mode has. SEG1-SEG8 carry the digit and its
+ * decimal point; the mode's remaining segments (SEG9 and up) are left to
+ * the annunciators and go out in the same RAM burst as the digits.
+ *
  * Build this driver as a module or built-in.
  */
 
@@ -35,6 +130,8 @@
 #include <linux/of.h>
 #include <linux/of_gpio.h>
 #include <linux/platform_device.h>
+#include <linux/spi/spi.h>
+#include <linux/bitrev.h>
 #include <linux/gpio/consumer.h>
 #include <linux/delay.h>
 #include <linux/kthread.h>
@@ -44,52 +141,451 @@
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/jiffies.h>
+#include <linux/property.h>
+#include <linux/math64.h>
+#include <linux/minmax.h>
+#include <linux/bitops.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/input.h>
+#include <linux/input/matrix_keypad.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
+#include <linux/kfifo.h>
+#include <linux/list.h>
+#include <linux/hrtimer.h>
+#include <linux/mutex.h>
+#include <linux/rwsem.h>
+#include <linux/overflow.h>
+#include <linux/idr.h>
+#include <linux/kref.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
+#include <linux/irqflags.h>
+#include <linux/pm_runtime.h>
+#include <linux/cpumask.h>
+#include <linux/sched.h>
+#include <linux/sched/prio.h>
+#include <uapi/linux/sched/types.h>
+
+#define CREATE_TRACE_POINTS
+#include "tm1628_trace.h"
+
+#include "tm1628_ioctl.h"
 
 #define DRIVER_NAME "tm1628"
 
-/* GPIO descriptors obtained from DT */
-static struct gpio_desc *gpiod_stb;
-static struct gpio_desc *gpiod_dio;
-static struct gpio_desc *gpiod_clk;
-
-static struct task_struct *tm1628_thread;
-
-/* Digit map for segments (for digits 0-9) */
-static const unsigned char digit_map[10] = {
-	0x3F, /* 0 */
-	0x06, /* 1 */
-	0x5B, /* 2 */
-	0x4F, /* 3 */
-	0x66, /* 4 */
-	0x6D, /* 5 */
-	0x7D, /* 6 */
-	0x07, /* 7 */
-	0x7F, /* 8 */
-	0x6F  /* 9 */
+/* CLK and DIO bits in the bus_descs array used for combined writes */
+#define TM1628_BUS_CLK		BIT(0)
+#define TM1628_BUS_DIO		BIT(1)
+
+/* Datasheet limits */
+#define TM1628_MAX_CLK_HZ	1000000
+#define TM1628_MIN_PW_CLK_NS	400	/* CLK pulse width */
+#define TM1628_MIN_PW_STB_NS	1000	/* STB pulse width, CLK to STB */
+#define TM1628_MIN_WAIT_NS	1000	/* key read command to first data bit */
+
+#define TM1628_DEFAULT_CLK_HZ	500000
+#define TM1628_DEFAULT_SETUP_NS	100
+#define TM1628_DEFAULT_HOLD_NS	100
+
+/* GPIO writes averaged over this many iterations during calibration */
+#define TM1628_CAL_LOOPS	64
+
+/* Bus timing, all in ns */
+struct tm1628_timing {
+	unsigned int clk_low_ns;	/* CLK low phase, covers DIO set-up */
+	unsigned int clk_high_ns;	/* CLK high phase, covers DIO hold */
+	unsigned int stb_ns;		/* STB pulse width and CLK to STB gap */
+	unsigned int wait_ns;		/* key read command to first data bit */
+};
+
+/*
+ * Latency histogram in power-of-two microsecond buckets: bucket 0 is
+ * below 1 us, bucket n covers [2^(n-1), 2^n) us and the last one is open.
+ */
+#define TM1628_HIST_BUCKETS	16
+
+struct tm1628_hist {
+	u64 count[TM1628_HIST_BUCKETS];
+	u64 max_ns;
+};
+
+/*
+ * Glyphs for the whole 7-bit ASCII range, bit n = SEG(n+1): a-g in bits
+ * 0-6, the decimal point in bit 7. Characters with no sensible 7-segment
+ * shape stay blank.
+ */
+#define TM1628_SEG_DP		0x80
+
+static const u16 tm1628_font[128] = {
+	['-'] = 0x40, ['_'] = 0x08, ['='] = 0x48, ['\''] = 0x02,
+	['"'] = 0x22, ['`'] = 0x20, ['|'] = 0x30, ['^'] = 0x23,
+	['*'] = 0x63, ['?'] = 0x53, ['/'] = 0x52, ['\\'] = 0x64,
+	['('] = 0x39, ['['] = 0x39, [')'] = 0x0F, [']'] = 0x0F,
+	['0'] = 0x3F, ['1'] = 0x06, ['2'] = 0x5B, ['3'] = 0x4F,
+	['4'] = 0x66, ['5'] = 0x6D, ['6'] = 0x7D, ['7'] = 0x07,
+	['8'] = 0x7F, ['9'] = 0x6F,
+	['A'] = 0x77, ['B'] = 0x7C, ['C'] = 0x39, ['D'] = 0x5E,
+	['E'] = 0x79, ['F'] = 0x71, ['G'] = 0x3D, ['H'] = 0x76,
+	['I'] = 0x06, ['J'] = 0x1E, ['K'] = 0x76, ['L'] = 0x38,
+	['M'] = 0x37, ['N'] = 0x54, ['O'] = 0x3F, ['P'] = 0x73,
+	['Q'] = 0x67, ['R'] = 0x50, ['S'] = 0x6D, ['T'] = 0x78,
+	['U'] = 0x3E, ['V'] = 0x3E, ['W'] = 0x2A, ['X'] = 0x76,
+	['Y'] = 0x6E, ['Z'] = 0x5B,
+	['a'] = 0x5F, ['b'] = 0x7C, ['c'] = 0x58, ['d'] = 0x5E,
+	['e'] = 0x7B, ['f'] = 0x71, ['g'] = 0x6F, ['h'] = 0x74,
+	['i'] = 0x04, ['j'] = 0x0C, ['k'] = 0x76, ['l'] = 0x30,
+	['m'] = 0x37, ['n'] = 0x54, ['o'] = 0x5C, ['p'] = 0x73,
+	['q'] = 0x67, ['r'] = 0x50, ['s'] = 0x6D, ['t'] = 0x78,
+	['u'] = 0x1C, ['v'] = 0x1C, ['w'] = 0x2A, ['x'] = 0x76,
+	['y'] = 0x6E, ['z'] = 0x5B,
+};
+
+/*
+ * Per-mode layout, indexed by the display mode command. seg_mask covers
+ * the segment lines the mode drives; ann_mask is the part of it above
+ * SEG8, which text rendering leaves to the annunciators. SEG11 is not
+ * bonded out, and SEG12-SEG14 share pins with GRID7-GRID5, so each grid
+ * a mode adds takes one of them away.
+ */
+struct tm1628_layout {
+	const char *name;
+	unsigned int grids;
+	u16 seg_mask;
+	u16 ann_mask;
+};
+
+#define TM1628_SEG_1_10		GENMASK(9, 0)
+
+#define TM1628_LAYOUT(_name, _grids, _segs) {			\
+	.name = _name,						\
+	.grids = _grids,					\
+	.seg_mask = (_segs),					\
+	.ann_mask = (_segs) & ~GENMASK(7, 0),			\
+}
+
+static const struct tm1628_layout tm1628_layouts[] = {
+	[0x00] = TM1628_LAYOUT("4x13", 4, TM1628_SEG_1_10 | GENMASK(13, 11)),
+	[0x01] = TM1628_LAYOUT("5x12", 5, TM1628_SEG_1_10 | GENMASK(12, 11)),
+	[0x02] = TM1628_LAYOUT("6x11", 6, TM1628_SEG_1_10 | BIT(11)),
+	[0x03] = TM1628_LAYOUT("7x10", 7, TM1628_SEG_1_10),
 };
 
-/* For default 6x11 mode, grid addresses */
-static const unsigned char grid_addresses[6] = { 0xC0, 0xC2, 0xC4, 0xC6, 0xC8, 0xCA };
+/* TM1628 command bytes */
+#define TM1628_CMD_DATA_AUTO	0x40	/* write display RAM, auto-increment */
+#define TM1628_CMD_DATA_FIXED	0x44	/* write display RAM, fixed address */
+#define TM1628_CMD_READ_KEYS	0x42	/* read key data */
+#define TM1628_CMD_CONTROL	0x80	/* display control, low nibble = level */
+#define TM1628_CMD_ADDR		0xC0	/* address command, low nibble = address */
 
-/* Globals for sysfs control */
-static int current_brightness = 10;
-/* New global for time mode */
-static int time_enabled = 0;
+/*
+ * Display RAM is 14 bytes: two per grid, the even byte holding SEG1-SEG8
+ * and the odd byte SEG9-SEG14.
+ */
+#define TM1628_RAM_SIZE		TM1628_RAM_BYTES
+
+/* Longest text the marquee scrolls */
+#define TM1628_MARQUEE_MAX	128
+
+/* Date shown in time mode, see tm1628_display_time() */
+enum tm1628_date_format {
+	TM1628_DATE_OFF,
+	TM1628_DATE_DMY,
+	TM1628_DATE_MDY,
+	TM1628_DATE_YMD,
+};
+
+static const char * const tm1628_date_formats[] = {
+	[TM1628_DATE_OFF] = "off",
+	[TM1628_DATE_DMY] = "dmy",
+	[TM1628_DATE_MDY] = "mdy",
+	[TM1628_DATE_YMD] = "ymd",
+};
+
+/* What the display does in standby (runtime suspended) */
+enum tm1628_idle_display {
+	TM1628_IDLE_KEEP,	/* unchanged */
+	TM1628_IDLE_DIM,	/* lowest pulse width */
+	TM1628_IDLE_OFF,	/* display off, frames held until wakeup */
+};
+
+static const char * const tm1628_idle_displays[] = {
+	[TM1628_IDLE_KEEP] = "keep",
+	[TM1628_IDLE_DIM] = "dim",
+	[TM1628_IDLE_OFF] = "off",
+};
+
+#define TM1628_AUTOSUSPEND_MS	60000
+
+/* Work flags posted to the frame mailbox */
+#define TM1628_PEND_FRAME	BIT(0)
+#define TM1628_PEND_BRIGHTNESS	BIT(1)
+#define TM1628_PEND_MODE	BIT(2)
+#define TM1628_PEND_STANDBY	BIT(3)	/* standby entered or left */
 
 #define GRID_STR_SIZE 16
-static char grids_str[GRID_STR_SIZE] = "000000";
 
-/* Global for display mode command.
- * Supported values:
- *   0x00: 4x13, 0x01: 5x12, 0x02: 6x11 (default), 0x03: 7x10.
+#define TM1628_KEY_BYTES	5
+#define TM1628_KEY_BITS		(TM1628_KEY_BYTES * 8)
+/* Key matrix: K1-K2 are the rows, KS1-KS10 the columns */
+#define TM1628_KEY_ROWS		2
+#define TM1628_KEY_COLS		10
+#define TM1628_KEY_ROW_SHIFT	4	/* get_count_order(TM1628_KEY_COLS) */
+
+/* Per-key debounce state */
+enum tm1628_key_state {
+	TM1628_KS_RELEASED,
+	TM1628_KS_PRESSING,	/* seen down, not yet confirmed */
+	TM1628_KS_PRESSED,
+	TM1628_KS_RELEASING,	/* seen up, not yet confirmed */
+};
+
+#define TM1628_REGION_ANNS	16
+
+/*
+ * A display region from a DT child node: a range of grids and the
+ * annunciator bits it owns, written through its own sysfs directory
+ * without touching the rest of the display
+ */
+struct tm1628_region {
+	struct tm1628 *tm;
+	const char *name;
+	u8 first;		/* first grid */
+	u8 count;		/* grids */
+	u8 num_anns;
+	struct {
+		u8 grid;
+		u16 bit;
+	} anns[TM1628_REGION_ANNS];	/* bit n of ann_state lights anns[n] */
+	u16 ann_state;
+	char text[GRID_STR_SIZE];
+	struct tm1628_number number;
+	struct device_attribute text_attr;
+	struct device_attribute number_attr;
+	struct device_attribute ann_attr;
+	struct attribute *attrs[4];
+	struct attribute_group group;
+};
+
+struct tm1628;
+
+/*
+ * Bus transport. Every transfer is one strobe frame: write sends @len
+ * bytes, read sends @cmd and clocks in @len bytes after the datasheet
+ * wait time. Only the worker calls them; neither can fail in a way the
+ * callers could act on, so errors are reported and counted here.
  */
-static unsigned char mode_cmd = 0x02;  /* default 6x11 */
+struct tm1628_bus {
+	const char *name;
+	int (*init)(struct tm1628 *tm);
+	void (*write)(struct tm1628 *tm, const u8 *data, unsigned int len);
+	void (*read)(struct tm1628 *tm, u8 cmd, u8 *data, unsigned int len);
+};
+
+/* Per-instance state; one per matching DT node */
+struct tm1628 {
+	struct device *dev;
+	struct kref ref;	/* held by the device and by open files */
+	int id;
+	char name[16];		/* "tm1628-<id>" */
+	const char *label;
+	bool dead;		/* device removed, open files are orphaned */
+	/* Held shared by file ops for their whole run, exclusive by remove */
+	struct rw_semaphore ops_rwsem;
+
+	const struct tm1628_bus *bus;
+
+	/* SPI transport */
+	struct spi_device *spi;
+	u8 *spi_buf;		/* DMA-safe, one strobe frame */
+	bool spi_bitrev;	/* controller cannot do SPI_LSB_FIRST */
+
+	/* GPIO transport: descriptors obtained from DT */
+	struct gpio_desc *stb;
+	struct gpio_desc *dio;
+	struct gpio_desc *clk;
+	/* CLK and DIO, in this order, for combined array writes */
+	struct gpio_desc *bus_descs[2];
+
+	/* Timing required by DT/datasheet and the busy-wait left after calibration */
+	struct tm1628_timing timing;
+	struct tm1628_timing delay;
+	/* Set when one array write of CLK+DIO is cheaper than two single writes */
+	bool use_array;
+	/* Last level driven on DIO, for edge accounting */
+	int dio_level;
+
+	/*
+	 * Cumulative bus statistics, shown in debugfs. Written by the worker
+	 * that owns the bus, except coalesced which is under mbox_lock.
+	 */
+	struct {
+		u64 frames;	/* frames that changed the display RAM */
+		u64 bytes;	/* bytes clocked in either direction */
+		u64 edges;	/* STB, CLK and DIO transitions driven */
+		u64 busy_ns;	/* time spent in bus transfers */
+		u64 commands;	/* mode and display control commands */
+		u64 key_scans;
+		u64 presses;	/* debounced key presses */
+		u64 coalesced;	/* frames replaced before being committed */
+		u64 throttled;	/* commits deferred by max_fps */
+		u64 errors;	/* failed SPI transfers */
+	} stats;
+	/*
+	 * Wall time of each STB frame and, on GPIO, of the gaps between its
+	 * bytes, shown in debugfs latency. Written by the worker like stats.
+	 */
+	struct {
+		struct tm1628_hist frame;
+		struct tm1628_hist gap;
+		u64 byte_end_ns;	/* end of the last byte clocked */
+	} lat;
+	/* The bus GPIOs can be driven with interrupts off */
+	bool atomic_ok;
+	struct dentry *debugfs;
+
+	/*
+	 * Shadow copy of the chip's display RAM. Updates are diffed against it
+	 * so only the bytes that actually changed go out on the bus. It is
+	 * invalid until the first full write after (re)initialisation.
+	 */
+	unsigned char shadow_ram[TM1628_RAM_SIZE];
+	bool shadow_valid;
+	/*
+	 * Data setting command the chip last received (0 = unknown). It stays
+	 * in force across strobe frames, so a write in the same direction and
+	 * address mode as the previous one skips it; a key read replaces it.
+	 */
+	u8 data_cmd;
+
+	/*
+	 * Latest-wins mailbox between producers (sysfs, chardev, key echo,
+	 * time mode, player) and commit_work. Producers render into
+	 * pending_ram, flag the work and queue commit_work; an update posted
+	 * before the previous one was committed simply replaces it.
+	 */
+	spinlock_t mbox_lock;
+	unsigned char pending_ram[TM1628_RAM_SIZE];
+	unsigned long pending;
+
+	/*
+	 * Standby, driven by runtime PM: the PM callbacks set standby and
+	 * post TM1628_PEND_STANDBY, commit_work applies idle_display to the
+	 * chip and tracks what it applied in standby_applied.
+	 */
+	bool standby;
+	bool standby_applied;
+	enum tm1628_idle_display idle_display;
+
+	/* Frame commit rate limit, 0 = unlimited */
+	unsigned int max_fps;
+	/* Earliest jiffies at which the next frame may be committed */
+	unsigned long next_commit;
+
+	/*
+	 * Last rendered grid patterns and the annunciator bits merged into
+	 * them, so either can change without re-rendering the other.
+	 * Protected by mbox_lock.
+	 */
+	u16 glyphs[TM1628_MAX_GRIDS];
+	u16 annunciators[TM1628_MAX_GRIDS];
+	/* Annunciator bits claimed by DT regions, fixed after probe */
+	u16 region_anns[TM1628_MAX_GRIDS];
+
+	/* sysfs controlled state */
+	int brightness;
+	int time_enabled;
+	char grids_str[GRID_STR_SIZE];
+	struct tm1628_number number;	/* last value for the number attribute */
+	struct tm1628_region *regions;
+	unsigned int num_regions;
+	/* The common attributes plus one group per region */
+	const struct attribute_group **groups;
+	/* Display mode command, an index into tm1628_layouts[] */
+	unsigned char mode_cmd;
+
+	/*
+	 * The worker running all bus work, one item per job. Work items
+	 * never run concurrently, which is what serialises the bus.
+	 */
+	struct kthread_worker *worker;
+	struct kthread_delayed_work commit_work;	/* delayed by max_fps */
+	struct kthread_delayed_work scan_work;		/* self-rearming */
+	struct kthread_work time_work;
+	struct kthread_work anim_work;
+	struct device *class_dev;
+
+	/* Time mode, ticking on wall-clock second boundaries */
+	struct hrtimer time_timer;
+	time64_t time_sec;	/* second time_work is to show */
+	int tz_offset_min;
+	bool time_12h;
+	enum tm1628_date_format date_format;
+
+	/* Animation player, see tm1628_anim_step() */
+	struct hrtimer anim_timer;
+	struct mutex anim_mutex;	/* serialises play and stop */
+	struct tm1628_anim_seq *anim;
+	unsigned int anim_pos;
+	unsigned int anim_shown;	/* frame anim_work is to show */
+	unsigned int anim_loop;
+	unsigned int scroll_ms;
+	unsigned int marquee_loops;
+	char marquee[TM1628_MARQUEE_MAX + 1];
+
+	/* Key scan engine, see tm1628_debounce() */
+	struct {
+		unsigned char state[TM1628_KEY_BITS];
+		unsigned char count[TM1628_KEY_BITS];
+		u64 down;		/* debounced bitmap */
+		unsigned int interval_ms;
+	} keyscan;
+
+	/*
+	 * Keypad input device. Scancodes are MATRIX_SCAN_CODE(row, col); the
+	 * keycode table comes from DT "linux,keymap" (or the built-in 2x5
+	 * keypad) and can be remapped with EVIOCSKEYCODE. Only the positions
+	 * populated at probe are scanned, and only the first key_bytes bytes
+	 * of key data are clocked in. All of it is devm-managed, so it goes
+	 * with the platform device rather than with this struct.
+	 */
+	struct input_dev *input;
+	unsigned short *keycodes;
+	struct tm1628_key {
+		u8 bit;		/* bit in the key bitmap */
+		u8 scancode;
+	} *keys;
+	unsigned int num_keys;
+	unsigned int key_bytes;
+	u64 key_mask;		/* bits of the populated positions */
+
+	/* Key echo: one key per grid is shown until 10 s of inactivity */
+	char key_buffer[TM1628_MAX_GRIDS + 1];
+	int key_buffer_index;
+	unsigned long last_key_jiffies;
+
+	/* Character device */
+	struct miscdevice misc;
+	struct list_head clients;
+	spinlock_t clients_lock;
+	wait_queue_head_t key_wq;
+	struct tm1628_fb *fb;	/* shared framebuffer page for mmap() */
+};
 
-/* We want the sysfs node to appear as /sys/class/auxdisplay/ */
+/* /sys/class/auxdisplay/, shared by all instances */
 static struct class *auxdisplay_class;
+static DEFINE_IDA(tm1628_ida);
+/* debugfs tm1628/, one directory per instance */
+static struct dentry *tm1628_debugfs_root;
 
 /* Forward declaration */
-static void tm1628_display_grids(const char *str);
+static void tm1628_display_grids(struct tm1628 *tm, const char *str);
 
 /* --- Helper wrappers using GPIO descriptor APIs --- */
 static inline void tm1628_gpio_set_desc(struct gpio_desc *desc, int value)
@@ -97,538 +593,3073 @@ static inline void tm1628_gpio_set_desc(struct gpio_desc *desc, int value)
 	gpiod_set_value(desc, value);
 }
 
-static inline void tm1628_delay_us(unsigned int us)
+static inline void tm1628_delay_ns(unsigned int ns)
+{
+	if (ns)
+		ndelay(ns);
+}
+
+static inline void tm1628_set_stb(struct tm1628 *tm, int value)
+{
+	tm1628_gpio_set_desc(tm->stb, value);
+	tm->stats.edges++;
+}
+
+/* Falling CLK edge with the next data bit presented on DIO */
+static inline void tm1628_clk_low_dio(struct tm1628 *tm, int bit)
+{
+	tm->stats.edges += 1 + (bit != tm->dio_level);
+	tm->dio_level = bit;
+	if (tm->use_array) {
+		unsigned long values = bit ? TM1628_BUS_DIO : 0;
+
+		gpiod_set_array_value(ARRAY_SIZE(tm->bus_descs), tm->bus_descs,
+				      NULL, &values);
+	} else {
+		tm1628_gpio_set_desc(tm->clk, 0);
+		tm1628_gpio_set_desc(tm->dio, bit);
+	}
+}
+
+/* --- Bus Timing Setup --- */
+
+/* Average cost of one GPIO write, measured on the idle bus (STB high) */
+static unsigned int tm1628_measure_write_ns(struct tm1628 *tm, bool array)
+{
+	unsigned long idle = TM1628_BUS_CLK | TM1628_BUS_DIO;
+	u64 start;
+	int i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < TM1628_CAL_LOOPS; i++) {
+		if (array)
+			gpiod_set_array_value(ARRAY_SIZE(tm->bus_descs),
+					      tm->bus_descs, NULL, &idle);
+		else
+			tm1628_gpio_set_desc(tm->clk, 1);
+	}
+	return div_u64(ktime_get_ns() - start, TM1628_CAL_LOOPS);
+}
+
+static unsigned int tm1628_residual_ns(unsigned int want, unsigned int cost)
+{
+	return want > cost ? want - cost : 0;
+}
+
+/*
+ * Derive the bus timing from DT and calibrate it against the real cost of
+ * a GPIO write. Each interval ends with a GPIO write, so only the part of
+ * the interval that write does not already cover is busy-waited.
+ */
+static void tm1628_setup_timing(struct tm1628 *tm)
 {
-	udelay(us);
+	struct device *dev = tm->dev;
+	u32 freq = TM1628_DEFAULT_CLK_HZ;
+	u32 setup = TM1628_DEFAULT_SETUP_NS;
+	u32 hold = TM1628_DEFAULT_HOLD_NS;
+	u32 stb = TM1628_MIN_PW_STB_NS;
+	unsigned int half, single_ns, array_ns;
+
+	device_property_read_u32(dev, "clock-frequency", &freq);
+	device_property_read_u32(dev, "titanmec,setup-time-ns", &setup);
+	device_property_read_u32(dev, "titanmec,hold-time-ns", &hold);
+	device_property_read_u32(dev, "titanmec,strobe-time-ns", &stb);
+
+	freq = clamp_t(u32, freq, 1000, TM1628_MAX_CLK_HZ);
+	half = DIV_ROUND_UP(NSEC_PER_SEC, 2 * freq);
+
+	tm->timing.clk_low_ns = max3(half, (unsigned int)setup,
+				     (unsigned int)TM1628_MIN_PW_CLK_NS);
+	tm->timing.clk_high_ns = max3(half, (unsigned int)hold,
+				      (unsigned int)TM1628_MIN_PW_CLK_NS);
+	tm->timing.stb_ns = max_t(unsigned int, stb, TM1628_MIN_PW_STB_NS);
+	tm->timing.wait_ns = TM1628_MIN_WAIT_NS;
+
+	single_ns = tm1628_measure_write_ns(tm, false);
+	array_ns = tm1628_measure_write_ns(tm, true);
+	tm->use_array = array_ns < 2 * single_ns;
+
+	tm->delay.clk_low_ns = tm1628_residual_ns(tm->timing.clk_low_ns, single_ns);
+	tm->delay.clk_high_ns = tm1628_residual_ns(tm->timing.clk_high_ns, single_ns);
+	tm->delay.stb_ns = tm1628_residual_ns(tm->timing.stb_ns, single_ns);
+	tm->delay.wait_ns = tm1628_residual_ns(tm->timing.wait_ns, single_ns);
+
+	dev_info(dev, "bus %u Hz, CLK %u/%u ns, GPIO write %u ns (array %u ns), %s writes\n",
+		 freq, tm->timing.clk_low_ns, tm->timing.clk_high_ns,
+		 single_ns, array_ns, tm->use_array ? "array" : "single");
 }
 
 /* --- Low-Level TM1628 Functions --- */
-static void tm1628_send_byte(unsigned char data)
+static void tm1628_send_byte(struct tm1628 *tm, unsigned char data)
 {
 	int i;
 	for (i = 0; i < 8; i++) {
-		tm1628_gpio_set_desc(gpiod_clk, 0);
-		tm1628_delay_us(5);
-		tm1628_gpio_set_desc(gpiod_dio, (data >> i) & 0x01);
-		tm1628_delay_us(5);
-		tm1628_gpio_set_desc(gpiod_clk, 1);
-		tm1628_delay_us(5);
+		tm1628_clk_low_dio(tm, (data >> i) & 0x01);
+		tm1628_delay_ns(tm->delay.clk_low_ns);
+		tm1628_gpio_set_desc(tm->clk, 1);
+		tm1628_delay_ns(tm->delay.clk_high_ns);
 	}
+	tm->stats.edges += 8;
+	tm->stats.bytes++;
 }
 
-static void tm1628_send_command(unsigned char command)
+/*
+ * Bit-banged bytes per section run with local interrupts off. A frame is
+ * split into sections of this many bytes; the first one also covers STB
+ * going low and the last one STB going high, so a value at least as large
+ * as the longest frame (15) makes every frame atomic. 0 leaves the bus
+ * preemptible.
+ */
+static unsigned int atomic_bytes;
+module_param(atomic_bytes, uint, 0644);
+MODULE_PARM_DESC(atomic_bytes, "Bit-banged bytes per interrupts-off section, 0 = preemptible");
+
+static void tm1628_hist_add(struct tm1628_hist *h, u64 ns)
 {
-	tm1628_gpio_set_desc(gpiod_stb, 0);
-	tm1628_delay_us(5);
-	tm1628_send_byte(command);
-	tm1628_delay_us(5);
-	tm1628_gpio_set_desc(gpiod_stb, 1);
-	tm1628_delay_us(5);
+	unsigned int b = 0;
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+
+	if (us)
+		b = min_t(unsigned int, ilog2(us) + 1, TM1628_HIST_BUCKETS - 1);
+	h->count[b]++;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
 }
 
-static void tm1628_set_brightness(unsigned char level)
+static unsigned int tm1628_atomic_group(struct tm1628 *tm)
 {
-	unsigned char cmd = 0x80 | (level & 0x0F);
-	tm1628_send_command(cmd);
+	return tm->atomic_ok ? READ_ONCE(atomic_bytes) : 0;
 }
 
-/* Initialize display with selected configuration */
-static void tm1628_init_display(void)
+/*
+ * Start byte i of a frame: account the gap since the previous byte, then
+ * close the running atomic section and open the next at group boundaries.
+ */
+static void tm1628_byte_begin(struct tm1628 *tm, unsigned int i,
+			      unsigned int group, unsigned long *flags)
 {
-	tm1628_send_command(mode_cmd);
-	tm1628_send_command(0x40); /* Data command: auto-increment mode */
-	tm1628_set_brightness(current_brightness);
+	if (!i)
+		return;
+	if (group && i % group == 0) {
+		local_irq_restore(*flags);
+		local_irq_save(*flags);
+	}
+	tm1628_hist_add(&tm->lat.gap, ktime_get_ns() - tm->lat.byte_end_ns);
 }
 
-/* Display a pattern on all 6 grids */
-static void tm1628_display_pattern(const unsigned char pattern[6])
+static void tm1628_gpio_write(struct tm1628 *tm, const u8 *data,
+			      unsigned int len)
 {
-	int i;
-	tm1628_gpio_set_desc(gpiod_stb, 0);
-	tm1628_delay_us(5);
-	for (i = 0; i < 6; i++) {
-		tm1628_send_byte(grid_addresses[i]);
-		tm1628_send_byte(pattern[i]);
+	unsigned int group = tm1628_atomic_group(tm);
+	unsigned long flags = 0;
+	unsigned int i;
+	u64 start;
+
+	if (group)
+		local_irq_save(flags);
+	start = ktime_get_ns();
+	tm1628_set_stb(tm, 0);
+	tm1628_delay_ns(tm->delay.stb_ns);
+	for (i = 0; i < len; i++) {
+		tm1628_byte_begin(tm, i, group, &flags);
+		tm1628_send_byte(tm, data[i]);
+		tm->lat.byte_end_ns = ktime_get_ns();
 	}
-	tm1628_gpio_set_desc(gpiod_stb, 1);
-	tm1628_delay_us(5);
+	tm1628_delay_ns(tm->delay.stb_ns);
+	tm1628_set_stb(tm, 1);
+	tm1628_hist_add(&tm->lat.frame, ktime_get_ns() - start);
+	if (group)
+		local_irq_restore(flags);
+	tm1628_delay_ns(tm->delay.stb_ns);
 }
 
-/* Display a repeated digit with decimal point lit on all grids */
-static void __maybe_unused tm1628_display_repeated_dp(unsigned char digit)
+static void tm1628_send_command(struct tm1628 *tm, unsigned char command)
 {
-	unsigned char pattern[6];
-	int i;
-	for (i = 0; i < 6; i++)
-		pattern[i] = digit_map[digit] | 0x80;
-	tm1628_display_pattern(pattern);
+	tm->bus->write(tm, &command, 1);
 }
 
-/* Display current time in HH.MM.SS format */
-static void __maybe_unused tm1628_display_time(void)
+static void tm1628_set_brightness(struct tm1628 *tm, unsigned char level)
 {
-	unsigned char pattern[6];
-	struct timespec64 ts;
-	struct tm tm;
-	time64_t time_sec;
+	unsigned char cmd = TM1628_CMD_CONTROL | (level & 0x0F);
+	tm1628_send_command(tm, cmd);
+}
 
-	ktime_get_real_ts64(&ts);
-	time_sec = ts.tv_sec;
-	time64_to_tm(time_sec, 0, &tm);
+/* Send a data setting command unless the chip already has it */
+static void tm1628_set_data_cmd(struct tm1628 *tm, u8 cmd)
+{
+	if (tm->data_cmd == cmd)
+		return;
+	tm1628_send_command(tm, cmd);
+	tm->data_cmd = cmd;
+}
 
-	pattern[0] = digit_map[tm.tm_hour / 10];
-	pattern[1] = digit_map[tm.tm_hour % 10] | 0x80;
-	pattern[2] = digit_map[tm.tm_min / 10];
-	pattern[3] = digit_map[tm.tm_min % 10] | 0x80;
-	pattern[4] = digit_map[tm.tm_sec / 10];
-	pattern[5] = digit_map[tm.tm_sec % 10];
+/*
+ * Display control level (bit 3 = on, bits 2:0 = pulse width) for the
+ * brightness setting, as modified by standby
+ */
+static unsigned char tm1628_control_level(struct tm1628 *tm)
+{
+	unsigned char level = tm->brightness & 0x0F;
+
+	if (!tm->standby_applied)
+		return level;
+	switch (tm->idle_display) {
+	case TM1628_IDLE_DIM:
+		return level & 0x08;
+	case TM1628_IDLE_OFF:
+		return 0;
+	default:
+		return level;
+	}
+}
 
-	tm1628_display_pattern(pattern);
+/* Initialize display with selected configuration */
+static void tm1628_init_display(struct tm1628 *tm)
+{
+	tm1628_send_command(tm, tm->mode_cmd);
+	tm->data_cmd = 0;
+	tm1628_set_data_cmd(tm, TM1628_CMD_DATA_AUTO);
+	tm1628_set_brightness(tm, tm1628_control_level(tm));
+	/* Force the next frame out in full */
+	tm->shadow_valid = false;
 }
 
 /*
- * Process an amount string (e.g., "6999.09") to display on the grids.
- * (Not used in key mode but available for future use.)
+ * Bus cost of a RAM update in clock edges: 16 CLK edges per byte plus two
+ * STB edges per strobe frame. Either variant may first need a data command
+ * in its own frame, e.g. after a key scan left the chip in read mode.
  */
-static void __maybe_unused tm1628_display_amount(const char *amount_str)
+static unsigned int tm1628_data_cmd_cost(struct tm1628 *tm, u8 cmd)
 {
-	char digits[16];
-	int i, j;
+	return tm->data_cmd == cmd ? 0 : 16 + 2;
+}
 
-	j = 0;
-	for (i = 0; amount_str[i] != '\0'; i++) {
-		if (amount_str[i] != '.')
-			digits[j++] = amount_str[i];
-	}
-	digits[j] = '\0';
+static unsigned int tm1628_burst_cost(struct tm1628 *tm, int span)
+{
+	/* address + span data bytes in one frame */
+	return tm1628_data_cmd_cost(tm, TM1628_CMD_DATA_AUTO) +
+	       16 * (1 + span) + 2;
+}
 
-	{
-		int len = strlen(digits);
-		if (len > 5) {
-			memmove(digits, digits + (len - 5), 5);
-			digits[5] = '\0';
-		} else if (len < 5) {
-			char padded[6] = {0};
-			int pad = 5 - len;
-			for (i = 0; i < pad; i++)
-				padded[i] = '0';
-			strcpy(padded + pad, digits);
-			strcpy(digits, padded);
-		}
-	}
+static unsigned int tm1628_fixed_cost(struct tm1628 *tm, int dirty)
+{
+	/* one address + data frame per dirty byte */
+	return tm1628_data_cmd_cost(tm, TM1628_CMD_DATA_FIXED) +
+	       16 * 2 * dirty + 2 * dirty;
+}
 
-	{
-		char final[7];
-		final[0] = digits[0];
-		final[1] = digits[1];
-		final[2] = digits[2];
-		final[3] = '.';
-		final[4] = digits[3];
-		final[5] = digits[4];
-		final[6] = '\0';
-		tm1628_display_grids(final);
-	}
-}
-
-/*
- * Map a character (digit or letter A-Z) to a 7-segment pattern.
- */
-static unsigned char tm1628_map_char(char c)
-{
-	if (c >= '0' && c <= '9')
-		return digit_map[c - '0'];
-	if (c >= 'a' && c <= 'z')
-		c -= ('a' - 'A');
-	switch(c) {
-	case 'A': return 0x77;
-	case 'B': return 0x7C;
-	case 'C': return 0x39;
-	case 'D': return 0x5E;
-	case 'E': return 0x79;
-	case 'F': return 0x71;
-	case 'G': return 0x3D;
-	case 'H': return 0x76;
-	case 'I': return 0x06;
-	case 'J': return 0x1E;
-	case 'K': return 0x76;
-	case 'L': return 0x38;
-	case 'M': return 0x37;
-	case 'N': return 0x54;
-	case 'O': return 0x3F;
-	case 'P': return 0x73;
-	case 'Q': return 0x67;
-	case 'R': return 0x50;
-	case 'S': return 0x6D;
-	case 'T': return 0x78;
-	case 'U': return 0x3E;
-	case 'V': return 0x3E;
-	case 'W': return 0x2A;
-	case 'X': return 0x76;
-	case 'Y': return 0x6E;
-	case 'Z': return 0x5B;
-	default:  return 0x00;
-	}
-}
-
-/*
- * Process an input string (which may include '.') and build a 6-byte pattern.
- */
-static void tm1628_display_grids(const char *str)
-{
-	unsigned char pattern[6];
-	int len = strlen(str);
-	int i = 0, pat_index = 0;
+/*
+ * Bring the chip's display RAM in line with @ram. Only the bytes that
+ * differ from the shadow are sent, either as a single auto-increment burst
+ * covering first..last dirty byte or as fixed-address writes of each dirty
+ * byte, whichever takes fewer clock edges.
+ */
+static void tm1628_write_ram(struct tm1628 *tm,
+			     const unsigned char ram[TM1628_RAM_SIZE])
+{
+	u8 buf[1 + TM1628_RAM_SIZE];
+	int first = -1, last = -1, dirty = 0;
+	u64 start, bytes;
+	int i;
 
-	while (i < len && pat_index < 6) {
-		if (str[i] == '.') {
-			i++;
+	for (i = 0; i < TM1628_RAM_SIZE; i++) {
+		if (tm->shadow_valid && ram[i] == tm->shadow_ram[i])
 			continue;
-		}
-		{
-			unsigned char seg = tm1628_map_char(str[i]);
-			if ((i + 1 < len) && (str[i + 1] == '.')) {
-				seg |= 0x80;
-				i += 2;
-			} else {
-				i++;
-			}
-			pattern[pat_index++] = seg;
+		if (first < 0)
+			first = i;
+		last = i;
+		dirty++;
+	}
+	if (!dirty)
+		return;
+
+	start = ktime_get_ns();
+	bytes = tm->stats.bytes;
+	if (tm1628_burst_cost(tm, last - first + 1) <=
+	    tm1628_fixed_cost(tm, dirty)) {
+		tm1628_set_data_cmd(tm, TM1628_CMD_DATA_AUTO);
+		buf[0] = TM1628_CMD_ADDR | first;
+		memcpy(buf + 1, ram + first, last - first + 1);
+		tm->bus->write(tm, buf, last - first + 2);
+	} else {
+		tm1628_set_data_cmd(tm, TM1628_CMD_DATA_FIXED);
+		for (i = first; i <= last; i++) {
+			if (tm->shadow_valid && ram[i] == tm->shadow_ram[i])
+				continue;
+			buf[0] = TM1628_CMD_ADDR | i;
+			buf[1] = ram[i];
+			tm->bus->write(tm, buf, 2);
 		}
 	}
-	while (pat_index < 6)
-		pattern[pat_index++] = 0x00;
 
-	tm1628_display_pattern(pattern);
+	memcpy(tm->shadow_ram, ram, TM1628_RAM_SIZE);
+	tm->shadow_valid = true;
+
+	start = ktime_get_ns() - start;
+	tm->stats.busy_ns += start;
+	WRITE_ONCE(tm->stats.frames, tm->stats.frames + 1);
+	trace_tm1628_frame(tm->name, first, last - first + 1,
+			   tm->stats.bytes - bytes, start);
 }
 
-/* --- KEY SCANNING SECTION (Driver Version) --- */
+/* --- Frame Mailbox --- */
 
-/* Read one byte from the TM1628 key scanning */
-static unsigned char tm1628_read_byte_driver(void)
+/*
+ * Get posted work committed. A frame alone leaves a commit already
+ * delayed by the frame rate limit alone; anything else goes out now.
+ * Called with mbox_lock held, which orders it against remove setting
+ * ->dead before the worker goes away.
+ */
+static void tm1628_kick(struct tm1628 *tm)
 {
-	int i;
-	unsigned char byte = 0;
-	for (i = 0; i < 8; i++) {
-		tm1628_gpio_set_desc(gpiod_clk, 0);
-		tm1628_delay_us(5);
-		tm1628_gpio_set_desc(gpiod_clk, 1);
-		tm1628_delay_us(5);
-		{
-			int bit = gpiod_get_value(gpiod_dio);
-			if (bit < 0)
-				bit = 0;
-			byte |= ((bit & 0x01) << i);
-		}
-		tm1628_delay_us(5);
-	}
-	return byte;
+	lockdep_assert_held(&tm->mbox_lock);
+	if (tm->dead)
+		return;
+	if (tm->pending & ~TM1628_PEND_FRAME)
+		kthread_mod_delayed_work(tm->worker, &tm->commit_work, 0);
+	else
+		kthread_queue_delayed_work(tm->worker, &tm->commit_work, 0);
 }
 
-/* Read 5 bytes of key data from the TM1628 */
-static void tm1628_read_keys_driver(unsigned char key_data[5])
+static void tm1628_post(struct tm1628 *tm, unsigned long work)
 {
-	int i;
-	tm1628_gpio_set_desc(gpiod_stb, 0);
-	tm1628_delay_us(5);
-	tm1628_send_byte(0x42);  /* Send key read command */
-	tm1628_delay_us(5);
-
-	/* Set DIO as input */
-	gpiod_direction_input(gpiod_dio);
-	for (i = 0; i < 5; i++) {
-		key_data[i] = tm1628_read_byte_driver();
-		tm1628_delay_us(5);
-	}
-	/* Restore DIO as output */
-	gpiod_direction_output(gpiod_dio, 1);
+	unsigned long flags;
 
-	tm1628_gpio_set_desc(gpiod_stb, 1);
-	tm1628_delay_us(5);
+	spin_lock_irqsave(&tm->mbox_lock, flags);
+	tm->pending |= work;
+	tm1628_kick(tm);
+	spin_unlock_irqrestore(&tm->mbox_lock, flags);
 }
 
-/* Key mapping for a 2-row x 5-column keypad */
-struct key_pos {
-	int byte;
-	int bit;
-	char key;
-};
-
-static struct key_pos key_map[10] = {
-	{0, 0, '2'},
-	{0, 1, '1'},
-	{0, 3, '4'},
-	{0, 4, '3'},
-	{1, 0, '5'},
-	{1, 1, '6'},
-	{1, 3, '7'},
-	{1, 4, '8'},
-	{2, 0, '9'},
-	{2, 1, '0'}
-};
+/*
+ * User activity (sysfs, chardev, keys) restarts the autosuspend delay and
+ * brings the device out of standby. Timer-driven updates such as time
+ * mode and the player do not count. Safe in atomic context.
+ */
+static void tm1628_activity(struct tm1628 *tm)
+{
+	if (READ_ONCE(tm->dead))
+		return;
+	pm_runtime_get(tm->dev);
+	pm_runtime_mark_last_busy(tm->dev);
+	pm_runtime_put_autosuspend(tm->dev);
+}
 
-/* Return the first pressed key from key_data or '\0' if none */
-static char get_pressed_key_driver(unsigned char key_data[5])
+static const struct tm1628_layout *tm1628_layout(struct tm1628 *tm)
 {
-	int i;
-	for (i = 0; i < 10; i++) {
-		if (key_data[key_map[i].byte] & (1 << key_map[i].bit))
-			return key_map[i].key;
-	}
-	return '\0';
-}
-
-/* --- Kernel Thread Function with Startup and Key Scanning / Time Mode --- */
-static int tm1628_thread_fn(void *data)
-{
-	int d;
-	char disp_str[16];
-
-	/* --- Startup Sequence --- */
-	for (d = 0; d <= 9; d++) {
-		snprintf(disp_str, sizeof(disp_str), "%c.%c.%c.%c.%c.%c",
-		         '0' + d, '0' + d, '0' + d, '0' + d, '0' + d, '0' + d);
-		tm1628_display_grids(disp_str);
-		ssleep(1);
-	}
-	tm1628_display_grids("E.S.S.A.E.");
-	ssleep(1);
-	tm1628_display_grids("0.0.0.0.0.0");
-
-	/* --- Key Scanning / Time Mode --- */
-	{
-		char key_buffer[7] = {0};  /* Buffer for up to 6 keys (plus terminator) */
-		int key_buffer_index = 0;
-		unsigned char key_data[5];
-		unsigned long last_key_jiffies = jiffies;
-
-		while (!kthread_should_stop()) {
-			/* If time mode is enabled, update the display with current time */
-			if (time_enabled) {
-				tm1628_display_time();
-				msleep(1000);
-				continue;
-			}
+	return &tm1628_layouts[READ_ONCE(tm->mode_cmd)];
+}
 
-			memset(key_data, 0, sizeof(key_data));
-			tm1628_read_keys_driver(key_data);
-			{
-				char key = get_pressed_key_driver(key_data);
-				if (key != '\0') {
-					last_key_jiffies = jiffies;
-					if (key_buffer_index < 6) {
-						key_buffer[key_buffer_index++] = key;
-						key_buffer[key_buffer_index] = '\0';
-					} else {
-						/* Shift left and append new key */
-						memmove(key_buffer, key_buffer + 1, 5);
-						key_buffer[5] = key;
-					}
-					tm1628_display_grids(key_buffer);
-					pr_info("TM1628: Keys pressed: %s\n", key_buffer);
-				} else {
-					/* If no key pressed for 10 seconds, clear the buffer */
-					if (time_after(jiffies, last_key_jiffies + msecs_to_jiffies(10000)) && key_buffer_index != 0) {
-						key_buffer_index = 0;
-						key_buffer[0] = '\0';
-						tm1628_display_grids("0.0.0.0.0.0");
-						pr_info("TM1628: Clearing key buffer after inactivity.\n");
-					}
-				}
-			}
-			msleep(200);
-		}
+/*
+ * Lay glyphs and annunciators out in pending_ram for the current mode:
+ * each grid's 16-bit pattern fills both of its RAM bytes, grids and
+ * segment lines the mode does not drive are cleared. Called with
+ * mbox_lock held.
+ */
+static void tm1628_render_locked(struct tm1628 *tm)
+{
+	const struct tm1628_layout *layout = tm1628_layout(tm);
+	u16 pat;
+	int g;
+
+	for (g = 0; g < TM1628_MAX_GRIDS; g++) {
+		pat = 0;
+		if (g < layout->grids)
+			pat = (tm->glyphs[g] & layout->seg_mask) |
+			      (tm->annunciators[g] & layout->ann_mask);
+		tm->pending_ram[2 * g] = pat & 0xFF;
+		tm->pending_ram[2 * g + 1] = pat >> 8;
 	}
-	return 0;
+	if (tm->pending & TM1628_PEND_FRAME)
+		tm->stats.coalesced++;
+	tm->pending |= TM1628_PEND_FRAME;
+}
+
+/*
+ * Post one 16-bit pattern per grid; grids past @count are blanked. Never
+ * touches the bus; commit_work commits the newest posted frame.
+ */
+static void tm1628_display_glyphs(struct tm1628 *tm, const u16 *glyphs,
+				  int count)
+{
+	unsigned long flags;
+
+	count = min(count, TM1628_MAX_GRIDS);
+	spin_lock_irqsave(&tm->mbox_lock, flags);
+	memset(tm->glyphs, 0, sizeof(tm->glyphs));
+	memcpy(tm->glyphs, glyphs, count * sizeof(*glyphs));
+	tm1628_render_locked(tm);
+	tm1628_kick(tm);
+	spin_unlock_irqrestore(&tm->mbox_lock, flags);
 }
 
-/* --- Sysfs Class Attribute Wrappers --- */
-static ssize_t brightness_show(const struct class *cls,
-			       const struct class_attribute *attr, char *buf)
+/* Switch display mode; the last glyphs are re-laid out for it */
+static void tm1628_set_mode(struct tm1628 *tm, unsigned char mode)
 {
-	return sprintf(buf, "%d\n", current_brightness);
+	unsigned long flags;
+
+	spin_lock_irqsave(&tm->mbox_lock, flags);
+	WRITE_ONCE(tm->mode_cmd, mode);
+	tm1628_render_locked(tm);
+	tm->pending |= TM1628_PEND_MODE;
+	tm1628_kick(tm);
+	spin_unlock_irqrestore(&tm->mbox_lock, flags);
 }
 
-static ssize_t brightness_store(const struct class *cls,
-				const struct class_attribute *attr,
-				const char *buf, size_t count)
+static void tm1628_set_annunciators(struct tm1628 *tm,
+				    const u16 ann[TM1628_MAX_GRIDS])
 {
-	unsigned long val;
-	int ret = kstrtoul(buf, 10, &val);
-	if (ret)
-		return ret;
-	if (val > 15)
-		val = 15;
-	current_brightness = val;
-	tm1628_set_brightness(current_brightness);
-	return count;
+	unsigned long flags;
+	int g;
+
+	/* Bits owned by a region are left to its own annunciators file */
+	spin_lock_irqsave(&tm->mbox_lock, flags);
+	for (g = 0; g < TM1628_MAX_GRIDS; g++)
+		tm->annunciators[g] = (ann[g] & ~tm->region_anns[g]) |
+				      (tm->annunciators[g] & tm->region_anns[g]);
+	tm1628_render_locked(tm);
+	tm1628_kick(tm);
+	spin_unlock_irqrestore(&tm->mbox_lock, flags);
 }
-static CLASS_ATTR_RW(brightness);
 
-static ssize_t time_show(const struct class *cls,
-			 const struct class_attribute *attr, char *buf)
+/* Post a complete display RAM image */
+static void tm1628_display_ram(struct tm1628 *tm,
+			       const unsigned char ram[TM1628_RAM_SIZE])
 {
-	return sprintf(buf, "%s\n", time_enabled ? "on" : "off");
+	unsigned long flags;
+
+	spin_lock_irqsave(&tm->mbox_lock, flags);
+	memcpy(tm->pending_ram, ram, TM1628_RAM_SIZE);
+	if (tm->pending & TM1628_PEND_FRAME)
+		tm->stats.coalesced++;
+	tm->pending |= TM1628_PEND_FRAME;
+	tm1628_kick(tm);
+	spin_unlock_irqrestore(&tm->mbox_lock, flags);
 }
 
-static ssize_t time_store(const struct class *cls,
-			  const struct class_attribute *attr,
-			  const char *buf, size_t count)
+static bool tm1628_frame_throttled(struct tm1628 *tm)
 {
-	if (sysfs_streq(buf, "on"))
-		time_enabled = 1;
-	else if (sysfs_streq(buf, "off")) {
-		time_enabled = 0;
-		/* Optionally reset the display when turning off time mode */
-		tm1628_display_grids(grids_str);
-	}
-	return count;
+	return tm->max_fps && time_before(jiffies, tm->next_commit);
 }
-static CLASS_ATTR_RW(time);
 
-static ssize_t display_show(const struct class *cls,
-			    const struct class_attribute *attr, char *buf)
+/* Frames are held back while the display is off in standby */
+static bool tm1628_frame_held(struct tm1628 *tm)
 {
-	return sprintf(buf, "%s\n", grids_str);
+	return tm->standby_applied && tm->idle_display == TM1628_IDLE_OFF;
 }
 
-static ssize_t display_store(const struct class *cls,
-			     const struct class_attribute *attr,
-			     const char *buf, size_t count)
+/* Send a mode or display control command, timed and traced */
+static void tm1628_control_command(struct tm1628 *tm, u8 cmd)
 {
-	size_t len = min(count, (size_t)(GRID_STR_SIZE - 1));
-	char tmp[GRID_STR_SIZE];
-	memcpy(tmp, buf, len);
-	tmp[len] = '\0';
-	if (tmp[len - 1] == '\n')
-		tmp[len - 1] = '\0';
-	strncpy(grids_str, tmp, GRID_STR_SIZE - 1);
-	grids_str[GRID_STR_SIZE - 1] = '\0';
-	tm1628_display_grids(grids_str);
-	return count;
+	u64 start = ktime_get_ns(), bytes = tm->stats.bytes;
+
+	tm1628_send_command(tm, cmd);
+	start = ktime_get_ns() - start;
+	tm->stats.busy_ns += start;
+	tm->stats.commands++;
+	trace_tm1628_command(tm->name, cmd, tm->stats.bytes - bytes, start);
 }
-static CLASS_ATTR_RW(display);
 
-static ssize_t displaymode_config_show(const struct class *cls,
-				       const struct class_attribute *attr, char *buf)
+/*
+ * Carry out posted work as one bus transaction, in the order the datasheet
+ * gives for an update: display mode, data setting, address and data, then
+ * display control. Each command needs a strobe frame of its own, but the
+ * data setting is skipped when the chip already has it, and a frame and
+ * the commands posted with it go out back to back: a mode change lands
+ * with the frame rendered for it (which the rate limit does not hold
+ * back), and a wakeup switches the display on only after its frame.
+ * Worker context only.
+ */
+static void tm1628_commit_pending(struct tm1628 *tm)
 {
-	const char *cfg;
-	switch (mode_cmd) {
-	case 0x00: cfg = "4x13"; break;
-	case 0x01: cfg = "5x12"; break;
-	case 0x02: cfg = "6x11"; break;
-	case 0x03: cfg = "7x10"; break;
-	default:   cfg = "unknown"; break;
+	unsigned char ram[TM1628_RAM_SIZE];
+	unsigned long flags, work;
+
+	spin_lock_irqsave(&tm->mbox_lock, flags);
+	work = tm->pending;
+	if (work & TM1628_PEND_STANDBY)
+		tm->standby_applied = READ_ONCE(tm->standby);
+	if ((work & TM1628_PEND_FRAME) && !(work & TM1628_PEND_MODE)) {
+		if (tm1628_frame_throttled(tm)) {
+			work &= ~TM1628_PEND_FRAME;
+			tm->stats.throttled++;
+		} else if (tm1628_frame_held(tm)) {
+			work &= ~TM1628_PEND_FRAME;
+		}
 	}
-	return sprintf(buf, "%s\n", cfg);
+	tm->pending &= ~work;
+	if (work & TM1628_PEND_FRAME)
+		memcpy(ram, tm->pending_ram, TM1628_RAM_SIZE);
+	spin_unlock_irqrestore(&tm->mbox_lock, flags);
+
+	if (work & TM1628_PEND_MODE) {
+		tm1628_control_command(tm, tm->mode_cmd);
+		/* Grids map to other RAM bytes now, rewrite all of it */
+		tm->data_cmd = 0;
+		tm->shadow_valid = false;
+	}
+
+	if (work & TM1628_PEND_FRAME) {
+		tm1628_write_ram(tm, ram);
+		if (tm->max_fps)
+			tm->next_commit = jiffies + max(1UL, HZ / tm->max_fps);
+	}
+
+	if (work & (TM1628_PEND_MODE | TM1628_PEND_BRIGHTNESS |
+		    TM1628_PEND_STANDBY))
+		tm1628_control_command(tm, TM1628_CMD_CONTROL |
+					   tm1628_control_level(tm));
 }
 
-static ssize_t displaymode_config_store(const struct class *cls,
-					const struct class_attribute *attr,
-					const char *buf, size_t count)
+static void tm1628_commit_work(struct kthread_work *work)
 {
-	if (sysfs_streq(buf, "4x13"))
-		mode_cmd = 0x00;
-	else if (sysfs_streq(buf, "5x12"))
-		mode_cmd = 0x01;
-	else if (sysfs_streq(buf, "6x11"))
-		mode_cmd = 0x02;
-	else if (sysfs_streq(buf, "7x10"))
-		mode_cmd = 0x03;
-	else
-		return -EINVAL;
-	tm1628_init_display();
-	return count;
+	struct tm1628 *tm = container_of(work, struct tm1628, commit_work.work);
+	bool standby = tm->standby_applied;
+
+	if (READ_ONCE(tm->dead))
+		return;
+	tm1628_commit_pending(tm);
+
+	/* Entering or leaving standby changes the scan interval */
+	if (tm->standby_applied != standby)
+		kthread_mod_delayed_work(tm->worker, &tm->scan_work, 0);
+	/* A frame held back by the rate limit goes out once it allows */
+	if ((READ_ONCE(tm->pending) & TM1628_PEND_FRAME) &&
+	    tm1628_frame_throttled(tm))
+		kthread_queue_delayed_work(tm->worker, &tm->commit_work,
+				max(1L, (long)(tm->next_commit - jiffies)));
 }
-static CLASS_ATTR_RW(displaymode_config);
 
-/* --- Platform Driver Probe and Remove --- */
-static int tm1628_probe(struct platform_device *pdev)
+static u16 tm1628_digit(unsigned int d)
 {
-	int ret;
+	return tm1628_font['0' + d % 10];
+}
 
-	gpiod_stb = devm_gpiod_get(&pdev->dev, "stb", GPIOD_OUT_HIGH);
-	if (IS_ERR(gpiod_stb)) {
-		dev_err(&pdev->dev, "Failed to get STB GPIO\n");
-		return PTR_ERR(gpiod_stb);
-	}
-	gpiod_dio = devm_gpiod_get(&pdev->dev, "dio", GPIOD_OUT_HIGH);
-	if (IS_ERR(gpiod_dio)) {
-		dev_err(&pdev->dev, "Failed to get DIO GPIO\n");
-		return PTR_ERR(gpiod_dio);
-	}
-	gpiod_clk = devm_gpiod_get(&pdev->dev, "clk", GPIOD_OUT_HIGH);
-	if (IS_ERR(gpiod_clk)) {
-		dev_err(&pdev->dev, "Failed to get CLK GPIO\n");
-		return PTR_ERR(gpiod_clk);
-	}
+/* Display a repeated digit with decimal point lit on all grids */
+static void tm1628_display_repeated_dp(struct tm1628 *tm, unsigned char digit)
+{
+	u16 glyphs[TM1628_MAX_GRIDS];
+	int i;
 
-	tm1628_init_display();
+	for (i = 0; i < TM1628_MAX_GRIDS; i++)
+		glyphs[i] = tm1628_digit(digit) | TM1628_SEG_DP;
+	tm1628_display_glyphs(tm, glyphs, TM1628_MAX_GRIDS);
+}
 
-	tm1628_thread = kthread_run(tm1628_thread_fn, NULL, "tm1628_thread");
-	if (IS_ERR(tm1628_thread)) {
-		dev_err(&pdev->dev, "Failed to create kernel thread\n");
-		return PTR_ERR(tm1628_thread);
-	}
+/* Two-digit fields separated by dots: "AA.BB.CC", or "AA.BB" if @pairs is 2 */
+static void tm1628_put_pairs(u16 glyphs[6], int a, int b, int c, int pairs)
+{
+	int v[3] = { a, b, c };
+	int i;
 
-	auxdisplay_class = class_create("auxdisplay");
-	if (IS_ERR(auxdisplay_class)) {
-		dev_err(&pdev->dev, "Failed to create class\n");
-		ret = PTR_ERR(auxdisplay_class);
-		goto fail_class;
+	for (i = 0; i < pairs; i++) {
+		glyphs[2 * i] = tm1628_digit(v[i] / 10);
+		glyphs[2 * i + 1] = tm1628_digit(v[i]);
+		if (i + 1 < pairs)
+			glyphs[2 * i + 1] |= TM1628_SEG_DP;
 	}
-	ret = class_create_file(auxdisplay_class, &class_attr_brightness);
-	if (ret)
-		dev_err(&pdev->dev, "Failed to create brightness sysfs file\n");
-	ret = class_create_file(auxdisplay_class, &class_attr_time);
-	if (ret)
-		dev_err(&pdev->dev, "Failed to create time sysfs file\n");
-	ret = class_create_file(auxdisplay_class, &class_attr_display);
-	if (ret)
-		dev_err(&pdev->dev, "Failed to create display sysfs file\n");
-	ret = class_create_file(auxdisplay_class, &class_attr_displaymode_config);
-	if (ret)
-		dev_err(&pdev->dev, "Failed to create displaymode_config sysfs file\n");
+}
 
-	dev_info(&pdev->dev, "TM1628 driver loaded successfully\n");
-	return 0;
+/*
+ * Display @now (UTC seconds) as HH.MM.SS, or HH.MM on modes with fewer
+ * grids, in the configured zone and format. With a date format set, the
+ * date takes over for the last 2 s of every 10.
+ */
+static void tm1628_display_time(struct tm1628 *tm, time64_t now)
+{
+	int pairs = tm1628_layout(tm)->grids < 6 ? 2 : 3;
+	enum tm1628_date_format date = READ_ONCE(tm->date_format);
+	u16 glyphs[6];
+	struct tm t;
+	int hour;
+
+	time64_to_tm(now, READ_ONCE(tm->tz_offset_min) * 60, &t);
+
+	if (date != TM1628_DATE_OFF && t.tm_sec % 10 >= 8) {
+		int yy = (t.tm_year + 1900) % 100;
+		int mm = t.tm_mon + 1;
+
+		if (date == TM1628_DATE_DMY)
+			tm1628_put_pairs(glyphs, t.tm_mday, mm, yy, pairs);
+		else if (date == TM1628_DATE_MDY)
+			tm1628_put_pairs(glyphs, mm, t.tm_mday, yy, pairs);
+		else
+			tm1628_put_pairs(glyphs, yy, mm, t.tm_mday, pairs);
+		tm1628_display_glyphs(tm, glyphs, 2 * pairs);
+		return;
+	}
 
-fail_class:
-	class_destroy(auxdisplay_class);
-	kthread_stop(tm1628_thread);
-	return ret;
+	hour = t.tm_hour;
+	if (READ_ONCE(tm->time_12h))
+		hour = hour % 12 ? hour % 12 : 12;
+	tm1628_put_pairs(glyphs, hour, t.tm_min, t.tm_sec, pairs);
+	if (READ_ONCE(tm->time_12h)) {
+		if (hour < 10)
+			glyphs[0] = 0;
+		if (t.tm_hour >= 12)
+			glyphs[2 * pairs - 1] |= TM1628_SEG_DP;
+	}
+	tm1628_display_glyphs(tm, glyphs, 2 * pairs);
 }
 
-static int tm1628_remove(struct platform_device *pdev)
+/*
+ * Time mode tick. The timer runs on CLOCK_REALTIME in absolute mode and is
+ * re-armed for the next whole second from the current time, so it stays
+ * on the second boundary regardless of bus time, timer slack or clock
+ * steps. Only the digits that changed reach the bus, through the shadow
+ * RAM diff in tm1628_write_ram().
+ */
+static enum hrtimer_restart tm1628_time_tick(struct hrtimer *timer)
 {
-	class_remove_file(auxdisplay_class, &class_attr_brightness);
-	class_remove_file(auxdisplay_class, &class_attr_time);
-	class_remove_file(auxdisplay_class, &class_attr_display);
-	class_remove_file(auxdisplay_class, &class_attr_displaymode_config);
-	class_destroy(auxdisplay_class);
-	if (tm1628_thread)
-		kthread_stop(tm1628_thread);
-	dev_info(&pdev->dev, "TM1628 driver unloaded\n");
-	return 0;
+	struct tm1628 *tm = container_of(timer, struct tm1628, time_timer);
+	struct timespec64 ts;
+
+	ktime_get_real_ts64(&ts);
+	WRITE_ONCE(tm->time_sec, ts.tv_sec);
+	kthread_queue_work(tm->worker, &tm->time_work);
+	hrtimer_set_expires(timer, ktime_set(ts.tv_sec + 1, 0));
+	return HRTIMER_RESTART;
 }
 
-static const struct of_device_id tm1628_of_match[] = {
-	{ .compatible = "titanmec,tm1628", },
-	{ },
-};
-MODULE_DEVICE_TABLE(of, tm1628_of_match);
+static void tm1628_time_work(struct kthread_work *work)
+{
+	struct tm1628 *tm = container_of(work, struct tm1628, time_work);
 
-static struct platform_driver tm1628_driver = {
-	.driver = {
-		.name = DRIVER_NAME,
-		.of_match_table = tm1628_of_match,
-	},
-	.probe = tm1628_probe,
-	.remove = tm1628_remove,
-};
+	tm1628_display_time(tm, READ_ONCE(tm->time_sec));
+}
 
-module_platform_driver(tm1628_driver);
+static void tm1628_time_stop(struct tm1628 *tm)
+{
+	hrtimer_cancel(&tm->time_timer);
+	kthread_cancel_work_sync(&tm->time_work);
+}
 
-MODULE_LICENSE("GPL");
-MODULE_AUTHOR("Your Name");
-MODULE_DESCRIPTION("TM1628 LED Display Platform Driver with Integrated Key Scanning and Time Mode");
+/* Show the time now and then on every second boundary */
+static void tm1628_time_start(struct tm1628 *tm)
+{
+	hrtimer_start(&tm->time_timer, ktime_get_real(), HRTIMER_MODE_ABS);
+}
 
+/* Map a character to its glyph; anything outside 7-bit ASCII is blank */
+static u16 tm1628_map_char(char c)
+{
+	unsigned char uc = c;
+
+	return uc < ARRAY_SIZE(tm1628_font) ? tm1628_font[uc] : 0;
+}
+
+/*
+ * Render a string (which may include '.') into at most @max glyphs, a '.'
+ * lighting the decimal point of the preceding character. Returns the
+ * number of glyphs produced.
+ */
+static int tm1628_render_text(const char *str, u16 *glyphs, int max)
+{
+	int len = strlen(str);
+	int i = 0, n = 0;
+
+	while (i < len && n < max) {
+		if (str[i] == '.') {
+			i++;
+			continue;
+		}
+		glyphs[n] = tm1628_map_char(str[i++]);
+		if (i < len && str[i] == '.') {
+			glyphs[n] |= TM1628_SEG_DP;
+			i++;
+		}
+		n++;
+	}
+	return n;
+}
+
+/* Display a string on as many grids as the current mode has */
+static void tm1628_display_grids(struct tm1628 *tm, const char *str)
+{
+	u16 glyphs[TM1628_MAX_GRIDS];
+	int n;
+
+	n = tm1628_render_text(str, glyphs, tm1628_layout(tm)->grids);
+	tm1628_display_glyphs(tm, glyphs, n);
+}
+
+/*
+ * Render @num right-aligned into @grids glyphs straight from the font
+ * table, splitting off two digits per division. The minus sign sits left
+ * of the first shown digit. A value that does not fit, or one flagged as
+ * overflowing, shows a dash on every grid. Returns -EINVAL for bad
+ * decimals or flags.
+ */
+static int tm1628_render_number(const struct tm1628_number *num,
+				u16 *glyphs, int grids)
+{
+	bool neg = num->value < 0 || (num->flags & TM1628_NUM_MINUS);
+	u64 mag = num->value < 0 ? -(u64)num->value : num->value;
+	int dec = num->decimals, n = 0, width, shown, i;
+	u8 digits[20];
+	u32 rem;
+
+	if (dec >= grids || (num->flags & ~TM1628_NUM_FLAGS) ||
+	    memchr_inv(num->reserved, 0, sizeof(num->reserved)))
+		return -EINVAL;
+
+	do {
+		mag = div_u64_rem(mag, 100, &rem);
+		digits[n++] = rem % 10;
+		digits[n++] = rem / 10;
+	} while (mag);
+	while (n > 1 && !digits[n - 1])
+		n--;
+	/* At least the units digit and the decimals */
+	width = max(n, dec + 1);
+
+	if ((num->flags & TM1628_NUM_OVERFLOW) || width + neg > grids) {
+		for (i = 0; i < grids; i++)
+			glyphs[i] = tm1628_map_char('-');
+		return 0;
+	}
+
+	shown = (num->flags & TM1628_NUM_BLANK_ZEROS) ? width : grids - neg;
+	memset(glyphs, 0, grids * sizeof(*glyphs));
+	for (i = 0; i < shown; i++)
+		glyphs[grids - 1 - i] = tm1628_digit(i < n ? digits[i] : 0);
+	if (dec)
+		glyphs[grids - 1 - dec] |= TM1628_SEG_DP;
+	if (neg)
+		glyphs[grids - 1 - shown] = tm1628_map_char('-');
+	return 0;
+}
+
+/* Show a number on as many grids as the current mode has */
+static int tm1628_display_number(struct tm1628 *tm,
+				 const struct tm1628_number *num)
+{
+	u16 glyphs[TM1628_MAX_GRIDS];
+	int grids = tm1628_layout(tm)->grids;
+	int ret;
+
+	ret = tm1628_render_number(num, glyphs, grids);
+	if (ret)
+		return ret;
+	tm->number = *num;
+	tm1628_display_glyphs(tm, glyphs, grids);
+	return 0;
+}
+
+/*
+ * Post new contents for one region's grids, blanking those past @count.
+ * The rest of the display is left as it is and the frame goes out as one
+ * update, in which only the changed RAM bytes are sent.
+ */
+static void tm1628_region_glyphs(struct tm1628_region *region,
+				 const u16 *glyphs, int count)
+{
+	struct tm1628 *tm = region->tm;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&tm->mbox_lock, flags);
+	for (i = 0; i < region->count; i++)
+		tm->glyphs[region->first + i] = i < count ? glyphs[i] : 0;
+	tm1628_render_locked(tm);
+	tm1628_kick(tm);
+	spin_unlock_irqrestore(&tm->mbox_lock, flags);
+}
+
+/* Switch the region's annunciators; bit n of @state lights anns[n] */
+static void tm1628_region_anns(struct tm1628_region *region, u16 state)
+{
+	struct tm1628 *tm = region->tm;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&tm->mbox_lock, flags);
+	region->ann_state = state;
+	for (i = 0; i < region->num_anns; i++) {
+		if (state & BIT(i))
+			tm->annunciators[region->anns[i].grid] |= region->anns[i].bit;
+		else
+			tm->annunciators[region->anns[i].grid] &= ~region->anns[i].bit;
+	}
+	tm1628_render_locked(tm);
+	tm1628_kick(tm);
+	spin_unlock_irqrestore(&tm->mbox_lock, flags);
+}
+
+static int tm1628_region_number(struct tm1628_region *region,
+				const struct tm1628_number *num)
+{
+	u16 glyphs[TM1628_MAX_GRIDS];
+	int ret;
+
+	ret = tm1628_render_number(num, glyphs, region->count);
+	if (ret)
+		return ret;
+	region->number = *num;
+	tm1628_region_glyphs(region, glyphs, region->count);
+	return 0;
+}
+
+/* --- Animation Player --- */
+
+/* A frame sequence as played by the driver; frames use the UAPI layout */
+struct tm1628_anim_seq {
+	unsigned int count;
+	unsigned int loops;		/* 0 = forever */
+	bool splash;			/* a key press stops it too */
+	struct tm1628_anim_frame frames[];
+};
+
+static struct tm1628_anim_seq *tm1628_anim_alloc(unsigned int count,
+						 unsigned int loops)
+{
+	struct tm1628_anim_seq *seq;
+
+	seq = kzalloc(struct_size(seq, frames, count), GFP_KERNEL);
+	if (!seq)
+		return NULL;
+	seq->count = count;
+	seq->loops = loops;
+	return seq;
+}
+
+/* Move the play position on by @n frames; false once the sequence is over */
+static bool tm1628_anim_advance(struct tm1628 *tm, struct tm1628_anim_seq *seq,
+				u64 n)
+{
+	u64 pos = (u64)tm->anim_loop * seq->count + tm->anim_pos + n;
+
+	if (seq->loops && pos >= (u64)seq->loops * seq->count)
+		return false;
+	tm->anim_loop = div_u64_rem(pos, seq->count, &tm->anim_pos);
+	return true;
+}
+
+/*
+ * Timer callback: post the current frame and arm the timer for the next
+ * one. Expiry times advance in whole frame durations from the previous
+ * expiry, so frame timing does not drift. A late timer skips the frames
+ * whose time has already passed (counted in the late frame's duration)
+ * instead of bunching them up.
+ */
+static enum hrtimer_restart tm1628_anim_step(struct hrtimer *timer)
+{
+	struct tm1628 *tm = container_of(timer, struct tm1628, anim_timer);
+	struct tm1628_anim_seq *seq = tm->anim;
+	const struct tm1628_anim_frame *frame = &seq->frames[tm->anim_pos];
+	bool ended = false;
+	u64 overrun;
+
+	if (frame->duration_ms) {
+		overrun = hrtimer_forward_now(timer,
+					      ms_to_ktime(frame->duration_ms));
+		if (overrun > 1 && !tm1628_anim_advance(tm, seq, overrun - 1)) {
+			tm->anim_pos = seq->count - 1;
+			ended = true;
+		}
+	}
+
+	WRITE_ONCE(tm->anim_shown, tm->anim_pos);
+	kthread_queue_work(tm->worker, &tm->anim_work);
+
+	if (ended || !seq->frames[tm->anim_pos].duration_ms)
+		return HRTIMER_NORESTART;
+	if (!tm1628_anim_advance(tm, seq, 1))
+		return HRTIMER_NORESTART;
+	return HRTIMER_RESTART;
+}
+
+static void tm1628_anim_work(struct kthread_work *work)
+{
+	struct tm1628 *tm = container_of(work, struct tm1628, anim_work);
+
+	tm1628_display_glyphs(tm, tm->anim->frames[READ_ONCE(tm->anim_shown)].grids,
+			      TM1628_MAX_GRIDS);
+}
+
+/*
+ * Replace whatever is playing with @seq, which the player takes over.
+ * @marquee is the text @seq was built from, or NULL.
+ */
+static int tm1628_anim_play(struct tm1628 *tm, struct tm1628_anim_seq *seq,
+			    const char *marquee)
+{
+	struct tm1628_anim_seq *old;
+
+	mutex_lock(&tm->anim_mutex);
+	if (tm->dead) {
+		mutex_unlock(&tm->anim_mutex);
+		kfree(seq);
+		return -ENODEV;
+	}
+	hrtimer_cancel(&tm->anim_timer);
+	kthread_cancel_work_sync(&tm->anim_work);
+	old = tm->anim;
+	tm->anim = seq;
+	tm->anim_pos = 0;
+	tm->anim_loop = 0;
+	strscpy(tm->marquee, marquee ? marquee : "", sizeof(tm->marquee));
+	hrtimer_start(&tm->anim_timer, 0, HRTIMER_MODE_REL);
+	mutex_unlock(&tm->anim_mutex);
+
+	kfree(old);
+	return 0;
+}
+
+/* Stop playback, leaving the last frame shown */
+static void tm1628_anim_stop(struct tm1628 *tm)
+{
+	mutex_lock(&tm->anim_mutex);
+	/* Once dead the worker, and anim_work's pointer to it, are gone */
+	if (!tm->dead) {
+		hrtimer_cancel(&tm->anim_timer);
+		kthread_cancel_work_sync(&tm->anim_work);
+	}
+	tm->marquee[0] = '\0';
+	mutex_unlock(&tm->anim_mutex);
+}
+
+/* Stop the player if it is showing the startup splash */
+static void tm1628_splash_stop(struct tm1628 *tm)
+{
+	mutex_lock(&tm->anim_mutex);
+	if (!tm->dead && tm->anim && tm->anim->splash) {
+		hrtimer_cancel(&tm->anim_timer);
+		kthread_cancel_work_sync(&tm->anim_work);
+		tm->anim->splash = false;
+	}
+	mutex_unlock(&tm->anim_mutex);
+}
+
+/*
+ * Build a marquee: the text enters from the right, one grid per step,
+ * and scrolls out to the left, sized for the current mode's grid count.
+ */
+static struct tm1628_anim_seq *tm1628_marquee_build(struct tm1628 *tm,
+						    const char *text)
+{
+	u16 glyphs[TM1628_MARQUEE_MAX];
+	int grids = tm1628_layout(tm)->grids;
+	struct tm1628_anim_seq *seq;
+	int n, f, g, pos;
+
+	n = tm1628_render_text(text, glyphs, ARRAY_SIZE(glyphs));
+	seq = tm1628_anim_alloc(n + grids, READ_ONCE(tm->marquee_loops));
+	if (!seq)
+		return NULL;
+	for (f = 0; f < seq->count; f++) {
+		for (g = 0; g < grids; g++) {
+			pos = f + g - grids + 1;
+			if (pos >= 0 && pos < n)
+				seq->frames[f].grids[g] = glyphs[pos];
+		}
+		seq->frames[f].duration_ms = max(READ_ONCE(tm->scroll_ms), 1U);
+	}
+	return seq;
+}
+
+/* --- Startup Splash --- */
+static char *splash = "default";
+module_param(splash, charp, 0444);
+MODULE_PARM_DESC(splash, "Startup splash: \"default\", \"none\" or frames \"TEXT[@ms],...\" (DT: titanmec,splash)");
+
+#define TM1628_SPLASH_FRAMES	32
+#define TM1628_SPLASH_MS	1000
+
+/* Built-in splash: 0. to 9. on every grid, the banner, then 0. held */
+static struct tm1628_anim_seq *tm1628_splash_default(void)
+{
+	struct tm1628_anim_seq *seq;
+	int f, g;
+
+	seq = tm1628_anim_alloc(12, 1);
+	if (!seq)
+		return NULL;
+	for (f = 0; f < 12; f++) {
+		for (g = 0; g < TM1628_MAX_GRIDS; g++)
+			seq->frames[f].grids[g] = tm1628_digit(f == 11 ? 0 : f) |
+						  TM1628_SEG_DP;
+		seq->frames[f].duration_ms = TM1628_SPLASH_MS;
+	}
+	memset(seq->frames[10].grids, 0, sizeof(seq->frames[10].grids));
+	tm1628_render_text("E.S.S.A.E.", seq->frames[10].grids,
+			   TM1628_MAX_GRIDS);
+	seq->frames[11].duration_ms = 0;
+	return seq;
+}
+
+/*
+ * Frames given as "TEXT[@ms]". Without a duration a frame is shown for a
+ * second, except the last one, which is held until something else is
+ * written.
+ */
+static struct tm1628_anim_seq *tm1628_splash_parse(struct tm1628 *tm,
+						   const char **specs, int n)
+{
+	struct tm1628_anim_seq *seq;
+	char text[2 * TM1628_MAX_GRIDS + 1];
+	unsigned int ms;
+	const char *at;
+	int f;
+
+	seq = tm1628_anim_alloc(n, 1);
+	if (!seq)
+		return NULL;
+	for (f = 0; f < n; f++) {
+		at = strrchr(specs[f], '@');
+		ms = f == n - 1 ? 0 : TM1628_SPLASH_MS;
+		if (at && kstrtouint(at + 1, 10, &ms))
+			dev_warn(tm->dev, "Bad splash frame duration '%s'\n",
+				 specs[f]);
+		strscpy(text, specs[f],
+			min_t(size_t, sizeof(text),
+			      at ? at - specs[f] + 1 : strlen(specs[f]) + 1));
+		tm1628_render_text(text, seq->frames[f].grids, TM1628_MAX_GRIDS);
+		seq->frames[f].duration_ms = ms;
+	}
+	return seq;
+}
+
+/*
+ * Start the startup splash from DT "titanmec,splash" (a string per frame)
+ * or the splash module parameter (frames separated by ','). "none" leaves
+ * the display blank. The player runs it in the background, so probe does
+ * not wait for it, and any write or key press cuts it short.
+ */
+static void tm1628_play_splash(struct tm1628 *tm)
+{
+	const char *specs[TM1628_SPLASH_FRAMES];
+	struct tm1628_anim_seq *seq;
+	char *buf = NULL, *p;
+	int n;
+
+	n = device_property_string_array_count(tm->dev, "titanmec,splash");
+	if (n > 0) {
+		n = device_property_read_string_array(tm->dev, "titanmec,splash",
+				specs, min(n, TM1628_SPLASH_FRAMES));
+	} else {
+		buf = kstrdup(splash ? splash : "", GFP_KERNEL);
+		p = buf;
+		n = 0;
+		while (p && n < TM1628_SPLASH_FRAMES)
+			specs[n++] = strsep(&p, ",");
+	}
+
+	if (n <= 0 || (n == 1 && (!*specs[0] || !strcmp(specs[0], "none")))) {
+		tm1628_display_grids(tm, "");
+		kfree(buf);
+		return;
+	}
+	if (n == 1 && !strcmp(specs[0], "default"))
+		seq = tm1628_splash_default();
+	else
+		seq = tm1628_splash_parse(tm, specs, n);
+	kfree(buf);
+
+	if (!seq) {
+		tm1628_display_repeated_dp(tm, 0);
+		return;
+	}
+	seq->splash = true;
+	tm1628_anim_play(tm, seq, NULL);
+}
+
+/* --- KEY SCANNING SECTION (Driver Version) --- */
+
+/* Read one byte from the TM1628 key scanning */
+static unsigned char tm1628_read_byte_driver(struct tm1628 *tm)
+{
+	int i;
+	unsigned char byte = 0;
+	for (i = 0; i < 8; i++) {
+		tm1628_gpio_set_desc(tm->clk, 0);
+		tm1628_delay_ns(tm->delay.clk_low_ns);
+		tm1628_gpio_set_desc(tm->clk, 1);
+		{
+			int bit = gpiod_get_value(tm->dio);
+			if (bit < 0)
+				bit = 0;
+			byte |= ((bit & 0x01) << i);
+		}
+		tm1628_delay_ns(tm->delay.clk_high_ns);
+	}
+	tm->stats.edges += 16;
+	tm->stats.bytes++;
+	return byte;
+}
+
+static void tm1628_gpio_read(struct tm1628 *tm, u8 cmd, u8 *data,
+			     unsigned int len)
+{
+	unsigned int group = tm1628_atomic_group(tm);
+	unsigned long flags = 0;
+	unsigned int i;
+	u64 start;
+
+	/* The command is byte 0 of the frame, the key data bytes 1..len */
+	if (group)
+		local_irq_save(flags);
+	start = ktime_get_ns();
+	tm1628_set_stb(tm, 0);
+	tm1628_delay_ns(tm->delay.stb_ns);
+	tm1628_send_byte(tm, cmd);
+	tm->lat.byte_end_ns = ktime_get_ns();
+
+	/* Set DIO as input */
+	gpiod_direction_input(tm->dio);
+	tm1628_delay_ns(tm->delay.wait_ns);
+	for (i = 0; i < len; i++) {
+		tm1628_byte_begin(tm, 1 + i, group, &flags);
+		data[i] = tm1628_read_byte_driver(tm);
+		tm->lat.byte_end_ns = ktime_get_ns();
+	}
+	/* Restore DIO as output */
+	gpiod_direction_output(tm->dio, 1);
+	tm->dio_level = 1;
+
+	tm1628_delay_ns(tm->delay.stb_ns);
+	tm1628_set_stb(tm, 1);
+	tm1628_hist_add(&tm->lat.frame, ktime_get_ns() - start);
+	if (group)
+		local_irq_restore(flags);
+	tm1628_delay_ns(tm->delay.stb_ns);
+}
+
+/*
+ * Read the first tm->key_bytes bytes of key data from the TM1628; the chip
+ * does not mind the read ending early.
+ */
+static void tm1628_read_keys_driver(struct tm1628 *tm,
+				    unsigned char key_data[TM1628_KEY_BYTES])
+{
+	tm->bus->read(tm, TM1628_CMD_READ_KEYS, key_data, tm->key_bytes);
+	tm->data_cmd = TM1628_CMD_READ_KEYS;
+}
+
+/*
+ * Key data byte n holds columns KS(2n+1) in bits 0-1 and KS(2n+2) in
+ * bits 3-4, one bit per row.
+ */
+static unsigned int tm1628_key_bit(unsigned int row, unsigned int col)
+{
+	return (col / 2) * 8 + (col % 2) * 3 + row;
+}
+
+/* The 2x5 keypad wiring used when DT has no linux,keymap */
+static const u32 tm1628_default_keymap[] = {
+	MATRIX_KEY(0, 0, KEY_2), MATRIX_KEY(1, 0, KEY_1),
+	MATRIX_KEY(0, 1, KEY_4), MATRIX_KEY(1, 1, KEY_3),
+	MATRIX_KEY(0, 2, KEY_5), MATRIX_KEY(1, 2, KEY_6),
+	MATRIX_KEY(0, 3, KEY_7), MATRIX_KEY(1, 3, KEY_8),
+	MATRIX_KEY(0, 4, KEY_9), MATRIX_KEY(1, 4, KEY_0),
+};
+
+static const struct matrix_keymap_data tm1628_default_keymap_data = {
+	.keymap = tm1628_default_keymap,
+	.keymap_size = ARRAY_SIZE(tm1628_default_keymap),
+};
+
+/* Character echoed on the display for a keycode, 0 if none */
+static char tm1628_key_char(unsigned short code)
+{
+	if (code >= KEY_1 && code <= KEY_9)
+		return '1' + code - KEY_1;
+	switch (code) {
+	case KEY_0:
+		return '0';
+	case KEY_MINUS:
+		return '-';
+	case KEY_DOT:
+		return '.';
+	default:
+		return 0;
+	}
+}
+
+static bool key_echo = true;
+module_param(key_echo, bool, 0644);
+MODULE_PARM_DESC(key_echo, "Echo typed keys on the display");
+
+/*
+ * Key scan engine. The 5 key bytes are decoded into one bitmap (bit index
+ * byte * 8 + bit) and every position runs its own debounce state machine,
+ * so simultaneous presses and releases are all seen. Scanning runs at
+ * scan_fast_ms while any key is down or settling and backs off by doubling
+ * the interval up to scan_idle_ms once the keypad is quiet. The intervals
+ * are shared by all instances; each instance keeps its own scan state.
+ */
+static unsigned int scan_fast_ms = 10;
+module_param(scan_fast_ms, uint, 0644);
+MODULE_PARM_DESC(scan_fast_ms, "Key scan interval while keys are active (ms)");
+
+static unsigned int scan_idle_ms = 50;
+module_param(scan_idle_ms, uint, 0644);
+MODULE_PARM_DESC(scan_idle_ms, "Key scan interval once the keypad is idle (ms)");
+
+/* Scan interval in standby; 0 stops scanning, so only writes wake it */
+static unsigned int idle_scan_ms = 500;
+module_param(idle_scan_ms, uint, 0644);
+MODULE_PARM_DESC(idle_scan_ms, "Key scan interval in standby (ms), 0 = no scanning");
+
+static unsigned int debounce_scans = 2;
+module_param(debounce_scans, uint, 0644);
+MODULE_PARM_DESC(debounce_scans, "Consecutive scans needed to accept a key change");
+
+static u64 tm1628_key_bitmap(const unsigned char key_data[TM1628_KEY_BYTES])
+{
+	u64 raw = 0;
+	int i;
+
+	for (i = 0; i < TM1628_KEY_BYTES; i++)
+		raw |= (u64)key_data[i] << (8 * i);
+	return raw;
+}
+
+/*
+ * Feed one raw sample through the per-key state machines. Returns true if
+ * any key is down or settling; confirmed edges are reported in @pressed
+ * and @released.
+ */
+static bool tm1628_debounce(struct tm1628 *tm, u64 raw,
+			    u64 *pressed, u64 *released)
+{
+	unsigned int need = max(debounce_scans, 1U);
+	bool active = false;
+	int i;
+
+	*pressed = 0;
+	*released = 0;
+	for (i = 0; i < tm->key_bytes * 8; i++) {
+		bool down = raw & BIT_ULL(i);
+
+		switch (tm->keyscan.state[i]) {
+		case TM1628_KS_RELEASED:
+			if (!down)
+				break;
+			tm->keyscan.state[i] = TM1628_KS_PRESSING;
+			tm->keyscan.count[i] = 0;
+			fallthrough;
+		case TM1628_KS_PRESSING:
+			if (!down) {
+				tm->keyscan.state[i] = TM1628_KS_RELEASED;
+			} else if (++tm->keyscan.count[i] >= need) {
+				tm->keyscan.state[i] = TM1628_KS_PRESSED;
+				tm->keyscan.down |= BIT_ULL(i);
+				*pressed |= BIT_ULL(i);
+			}
+			break;
+		case TM1628_KS_PRESSED:
+			if (down)
+				break;
+			tm->keyscan.state[i] = TM1628_KS_RELEASING;
+			tm->keyscan.count[i] = 0;
+			fallthrough;
+		case TM1628_KS_RELEASING:
+			if (down) {
+				tm->keyscan.state[i] = TM1628_KS_PRESSED;
+			} else if (++tm->keyscan.count[i] >= need) {
+				tm->keyscan.state[i] = TM1628_KS_RELEASED;
+				tm->keyscan.down &= ~BIT_ULL(i);
+				*released |= BIT_ULL(i);
+			}
+			break;
+		}
+		if (tm->keyscan.state[i] != TM1628_KS_RELEASED)
+			active = true;
+	}
+	return active;
+}
+
+static void tm1628_echo_key(struct tm1628 *tm, char key)
+{
+	int grids = tm1628_layout(tm)->grids;
+
+	tm->last_key_jiffies = jiffies;
+	if (tm->key_buffer_index > grids) {
+		/* Mode shrank since the last key: keep the newest ones */
+		memmove(tm->key_buffer,
+			tm->key_buffer + tm->key_buffer_index - grids, grids);
+		tm->key_buffer_index = grids;
+	}
+	if (tm->key_buffer_index < grids) {
+		tm->key_buffer[tm->key_buffer_index++] = key;
+		tm->key_buffer[tm->key_buffer_index] = '\0';
+	} else {
+		/* Shift left and append new key */
+		memmove(tm->key_buffer, tm->key_buffer + 1, grids - 1);
+		tm->key_buffer[grids - 1] = key;
+		tm->key_buffer[grids] = '\0';
+	}
+	tm1628_display_grids(tm, tm->key_buffer);
+	dev_dbg(tm->dev, "Keys pressed: %s\n", tm->key_buffer);
+}
+
+static void tm1628_echo_idle(struct tm1628 *tm)
+{
+	/* If no key pressed for 10 seconds, clear the buffer */
+	if (tm->key_buffer_index != 0 &&
+	    time_after(jiffies, tm->last_key_jiffies + msecs_to_jiffies(10000))) {
+		tm->key_buffer_index = 0;
+		tm->key_buffer[0] = '\0';
+		tm1628_display_repeated_dp(tm, 0);
+		dev_dbg(tm->dev, "Clearing key buffer after inactivity.\n");
+	}
+}
+
+/* Report confirmed edges to the input device, stamped with the scan time */
+static void tm1628_report_keys(struct tm1628 *tm, u64 pressed, u64 released,
+			       ktime_t stamp)
+{
+	bool sync = false;
+	int i;
+
+	if (!tm->input || !(pressed | released))
+		return;
+
+	input_set_timestamp(tm->input, stamp);
+	for (i = 0; i < tm->num_keys; i++) {
+		const struct tm1628_key *key = &tm->keys[i];
+
+		if (released & BIT_ULL(key->bit)) {
+			input_event(tm->input, EV_MSC, MSC_SCAN, key->scancode);
+			input_report_key(tm->input, tm->keycodes[key->scancode], 0);
+			sync = true;
+		}
+		if (pressed & BIT_ULL(key->bit)) {
+			input_event(tm->input, EV_MSC, MSC_SCAN, key->scancode);
+			input_report_key(tm->input, tm->keycodes[key->scancode], 1);
+			sync = true;
+		}
+	}
+	if (sync)
+		input_sync(tm->input);
+}
+
+static void tm1628_chardev_key_event(struct tm1628 *tm, u64 pressed,
+				     u64 released, ktime_t stamp);
+
+/* Run one key scan; returns the delay until the next one in ms */
+static unsigned int tm1628_scan_keys(struct tm1628 *tm)
+{
+	unsigned char key_data[TM1628_KEY_BYTES] = { 0 };
+	u64 pressed, released, raw, busy;
+	ktime_t stamp;
+	bool active;
+	int i;
+
+	/* No keys in the keymap: never spend bus time on reads */
+	if (!tm->num_keys)
+		return UINT_MAX;
+
+	busy = ktime_get_ns();
+	tm1628_read_keys_driver(tm, key_data);
+	stamp = ktime_get();
+	busy = ktime_to_ns(stamp) - busy;
+	raw = tm1628_key_bitmap(key_data) & tm->key_mask;
+	active = tm1628_debounce(tm, raw, &pressed, &released);
+
+	/* Any key contact counts, so a press in standby wakes at once */
+	if (raw | pressed | released)
+		tm1628_activity(tm);
+	if (pressed)
+		tm1628_splash_stop(tm);
+
+	tm->stats.key_scans++;
+	tm->stats.presses += hweight64(pressed);
+	tm->stats.busy_ns += busy;
+	trace_tm1628_key_scan(tm->name, raw, pressed, released, busy);
+
+	tm1628_report_keys(tm, pressed, released, stamp);
+	if (pressed | released)
+		tm1628_chardev_key_event(tm, pressed, released, stamp);
+
+	/* Time mode owns the display; keys still go to input and readers */
+	if (key_echo && !READ_ONCE(tm->time_enabled)) {
+		for (i = 0; i < tm->num_keys; i++) {
+			char c = tm1628_key_char(tm->keycodes[tm->keys[i].scancode]);
+
+			if ((pressed & BIT_ULL(tm->keys[i].bit)) && c)
+				tm1628_echo_key(tm, c);
+		}
+		if (!tm->keyscan.down)
+			tm1628_echo_idle(tm);
+	}
+
+	if (tm->standby_applied)
+		return idle_scan_ms ? idle_scan_ms : UINT_MAX;
+
+	if (active)
+		tm->keyscan.interval_ms = scan_fast_ms;
+	else
+		tm->keyscan.interval_ms = min(max(tm->keyscan.interval_ms, 1U) * 2,
+					  scan_idle_ms);
+	return max(tm->keyscan.interval_ms, 1U);
+}
+
+/* Key scanning re-arms itself at the interval tm1628_scan_keys() asks for */
+static void tm1628_scan_work(struct kthread_work *work)
+{
+	struct tm1628 *tm = container_of(work, struct tm1628, scan_work.work);
+	unsigned int ms;
+
+	if (READ_ONCE(tm->dead))
+		return;
+	ms = tm1628_scan_keys(tm);
+	if (ms != UINT_MAX)
+		kthread_queue_delayed_work(tm->worker, &tm->scan_work,
+					   msecs_to_jiffies(ms));
+}
+
+/* --- Worker Scheduling --- */
+static char *sched_policy = "normal";
+module_param(sched_policy, charp, 0444);
+MODULE_PARM_DESC(sched_policy, "Worker policy: normal, fifo or rr (DT: titanmec,sched-policy)");
+
+static int sched_priority;
+module_param(sched_priority, int, 0444);
+MODULE_PARM_DESC(sched_priority, "Worker nice value, or RT priority for fifo/rr (DT: titanmec,sched-priority)");
+
+static char *cpus;
+module_param(cpus, charp, 0444);
+MODULE_PARM_DESC(cpus, "CPU list the workers may run on, e.g. \"1\" or \"2-3\" (DT: titanmec,cpus)");
+
+/*
+ * Apply the scheduling policy and CPU affinity to the instance's worker.
+ * DT properties override the module parameters; a bad value is reported
+ * and the worker keeps the default (SCHED_NORMAL, any CPU).
+ */
+static void tm1628_worker_setup(struct tm1628 *tm)
+{
+	struct device *dev = tm->dev;
+	struct task_struct *task = tm->worker->task;
+	struct sched_attr attr = { .size = sizeof(attr) };
+	const char *policy = sched_policy;
+	s32 prio = sched_priority;
+	cpumask_var_t mask;
+	int n, i, ret;
+
+	device_property_read_string(dev, "titanmec,sched-policy", &policy);
+	device_property_read_u32(dev, "titanmec,sched-priority", (u32 *)&prio);
+
+	if (!policy || sysfs_streq(policy, "normal")) {
+		attr.sched_policy = SCHED_NORMAL;
+		attr.sched_nice = clamp_t(s32, prio, MIN_NICE, MAX_NICE);
+	} else if (sysfs_streq(policy, "fifo") || sysfs_streq(policy, "rr")) {
+		attr.sched_policy = sysfs_streq(policy, "fifo") ? SCHED_FIFO : SCHED_RR;
+		attr.sched_priority = clamp_t(s32, prio, 1, MAX_RT_PRIO - 1);
+	} else {
+		dev_warn(dev, "Unknown scheduling policy '%s'\n", policy);
+		policy = "normal";
+		attr.sched_policy = SCHED_NORMAL;
+	}
+	ret = sched_setattr_nocheck(task, &attr);
+	if (ret)
+		dev_warn(dev, "Failed to set worker policy: %d\n", ret);
+	ret = 0;
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return;
+	n = device_property_count_u32(dev, "titanmec,cpus");
+	if (n > 0) {
+		u32 *list = kcalloc(n, sizeof(*list), GFP_KERNEL);
+
+		ret = list ? device_property_read_u32_array(dev, "titanmec,cpus",
+							    list, n) : -ENOMEM;
+		for (i = 0; !ret && i < n; i++) {
+			if (list[i] >= nr_cpu_ids)
+				ret = -EINVAL;
+			else
+				cpumask_set_cpu(list[i], mask);
+		}
+		kfree(list);
+	} else if (cpus && *cpus) {
+		ret = cpulist_parse(cpus, mask);
+	}
+	if (!ret && !cpumask_empty(mask))
+		ret = set_cpus_allowed_ptr(task, mask);
+	if (ret) {
+		dev_warn(dev, "Failed to set worker CPUs: %d\n", ret);
+		cpumask_clear(mask);
+	}
+
+	if (cpumask_empty(mask))
+		dev_info(dev, "worker: %s/%d on any CPU\n", policy, prio);
+	else
+		dev_info(dev, "worker: %s/%d on CPUs %*pbl\n", policy, prio,
+			 cpumask_pr_args(mask));
+	free_cpumask_var(mask);
+}
+
+/* Nothing is queued on the worker once this returns */
+static void tm1628_set_dead(struct tm1628 *tm)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&tm->mbox_lock, flags);
+	WRITE_ONCE(tm->dead, true);
+	spin_unlock_irqrestore(&tm->mbox_lock, flags);
+}
+
+/* The timers must be stopped and tm1628_set_dead() called first */
+static void tm1628_stop_worker(struct tm1628 *tm)
+{
+	kthread_flush_worker(tm->worker);
+	kthread_cancel_delayed_work_sync(&tm->scan_work);
+	kthread_cancel_delayed_work_sync(&tm->commit_work);
+	kthread_cancel_work_sync(&tm->time_work);
+	kthread_cancel_work_sync(&tm->anim_work);
+	kthread_destroy_worker(tm->worker);
+}
+
+/* --- Sysfs Device Attributes --- */
+static ssize_t brightness_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", tm->brightness);
+}
+
+static ssize_t brightness_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	unsigned long val;
+	int ret = kstrtoul(buf, 10, &val);
+	if (ret)
+		return ret;
+	if (val > 15)
+		val = 15;
+	tm->brightness = val;
+	tm1628_activity(tm);
+	tm1628_post(tm, TM1628_PEND_BRIGHTNESS);
+	return count;
+}
+static DEVICE_ATTR_RW(brightness);
+
+static ssize_t time_show(struct device *dev,
+			 struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", tm->time_enabled ? "on" : "off");
+}
+
+static ssize_t time_store(struct device *dev,
+			  struct device_attribute *attr,
+			  const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	tm1628_activity(tm);
+	if (sysfs_streq(buf, "on")) {
+		tm1628_anim_stop(tm);
+		WRITE_ONCE(tm->time_enabled, 1);
+		tm1628_time_start(tm);
+	} else if (sysfs_streq(buf, "off")) {
+		WRITE_ONCE(tm->time_enabled, 0);
+		tm1628_time_stop(tm);
+		/* Optionally reset the display when turning off time mode */
+		tm1628_display_grids(tm, tm->grids_str);
+	}
+	return count;
+}
+static DEVICE_ATTR_RW(time);
+
+static ssize_t time_format_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", tm->time_12h ? "12h" : "24h");
+}
+
+static ssize_t time_format_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	if (sysfs_streq(buf, "24h"))
+		WRITE_ONCE(tm->time_12h, false);
+	else if (sysfs_streq(buf, "12h"))
+		WRITE_ONCE(tm->time_12h, true);
+	else
+		return -EINVAL;
+	return count;
+}
+static DEVICE_ATTR_RW(time_format);
+
+static ssize_t date_format_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", tm1628_date_formats[tm->date_format]);
+}
+
+static ssize_t date_format_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	int i;
+
+	i = sysfs_match_string(tm1628_date_formats, buf);
+	if (i < 0)
+		return i;
+	WRITE_ONCE(tm->date_format, i);
+	return count;
+}
+static DEVICE_ATTR_RW(date_format);
+
+static ssize_t tz_offset_min_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", tm->tz_offset_min);
+}
+
+static ssize_t tz_offset_min_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	int val;
+	int ret = kstrtoint(buf, 10, &val);
+	if (ret)
+		return ret;
+	/* UTC-12:00 to UTC+14:00 */
+	if (val < -12 * 60 || val > 14 * 60)
+		return -ERANGE;
+	WRITE_ONCE(tm->tz_offset_min, val);
+	return count;
+}
+static DEVICE_ATTR_RW(tz_offset_min);
+
+static ssize_t display_show(struct device *dev,
+			    struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", tm->grids_str);
+}
+
+static ssize_t display_store(struct device *dev,
+			     struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	size_t len = min(count, (size_t)(GRID_STR_SIZE - 1));
+	char tmp[GRID_STR_SIZE];
+	memcpy(tmp, buf, len);
+	tmp[len] = '\0';
+	if (tmp[len - 1] == '\n')
+		tmp[len - 1] = '\0';
+	strncpy(tm->grids_str, tmp, GRID_STR_SIZE - 1);
+	tm->grids_str[GRID_STR_SIZE - 1] = '\0';
+	tm1628_activity(tm);
+	tm1628_anim_stop(tm);
+	tm1628_display_grids(tm, tm->grids_str);
+	return count;
+}
+static DEVICE_ATTR_RW(display);
+
+static ssize_t number_show(struct device *dev,
+			   struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lld %u 0x%x\n", tm->number.value,
+		       tm->number.decimals, tm->number.flags);
+}
+
+/* "<value> [<decimals> [<flags>]]", e.g. "699909 2" is 6999.09 */
+static int tm1628_parse_number(const char *buf, struct tm1628_number *num)
+{
+	unsigned int dec = 0, flags = 0;
+
+	memset(num, 0, sizeof(*num));
+	if (sscanf(buf, "%lld %u %i", &num->value, &dec, &flags) < 1 ||
+	    dec > U8_MAX || flags > U8_MAX)
+		return -EINVAL;
+	num->decimals = dec;
+	num->flags = flags;
+	return 0;
+}
+
+static ssize_t number_store(struct device *dev,
+			    struct device_attribute *attr,
+			    const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	struct tm1628_number num;
+	int ret;
+
+	ret = tm1628_parse_number(buf, &num);
+	if (ret)
+		return ret;
+
+	tm1628_activity(tm);
+	tm1628_anim_stop(tm);
+	ret = tm1628_display_number(tm, &num);
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(number);
+
+/* --- Display Regions --- */
+
+/* region-<name>/text: text for the region's grids, like display */
+static ssize_t tm1628_region_text_show(struct device *dev,
+				       struct device_attribute *attr, char *buf)
+{
+	struct tm1628_region *region =
+		container_of(attr, struct tm1628_region, text_attr);
+
+	return sprintf(buf, "%s\n", region->text);
+}
+
+static ssize_t tm1628_region_text_store(struct device *dev,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct tm1628_region *region =
+		container_of(attr, struct tm1628_region, text_attr);
+	u16 glyphs[TM1628_MAX_GRIDS];
+	int n;
+
+	strscpy(region->text, buf, sizeof(region->text));
+	region->text[strcspn(region->text, "\n")] = '\0';
+	n = tm1628_render_text(region->text, glyphs, region->count);
+	tm1628_activity(region->tm);
+	tm1628_anim_stop(region->tm);
+	tm1628_region_glyphs(region, glyphs, n);
+	return count;
+}
+
+/* region-<name>/number: a fixed-point number, like number */
+static ssize_t tm1628_region_number_show(struct device *dev,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	struct tm1628_region *region =
+		container_of(attr, struct tm1628_region, number_attr);
+
+	return sprintf(buf, "%lld %u 0x%x\n", region->number.value,
+		       region->number.decimals, region->number.flags);
+}
+
+static ssize_t tm1628_region_number_store(struct device *dev,
+					  struct device_attribute *attr,
+					  const char *buf, size_t count)
+{
+	struct tm1628_region *region =
+		container_of(attr, struct tm1628_region, number_attr);
+	struct tm1628_number num;
+	int ret;
+
+	ret = tm1628_parse_number(buf, &num);
+	if (ret)
+		return ret;
+	tm1628_activity(region->tm);
+	tm1628_anim_stop(region->tm);
+	ret = tm1628_region_number(region, &num);
+	return ret ? ret : count;
+}
+
+/* region-<name>/annunciators: bit n lights the n-th DT annunciator */
+static ssize_t tm1628_region_ann_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct tm1628_region *region =
+		container_of(attr, struct tm1628_region, ann_attr);
+
+	return sprintf(buf, "0x%x\n", region->ann_state);
+}
+
+static ssize_t tm1628_region_ann_store(struct device *dev,
+				       struct device_attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct tm1628_region *region =
+		container_of(attr, struct tm1628_region, ann_attr);
+	u16 state;
+	int ret;
+
+	ret = kstrtou16(buf, 0, &state);
+	if (ret)
+		return ret;
+	if (state & ~(BIT(region->num_anns) - 1))
+		return -EINVAL;
+	tm1628_activity(region->tm);
+	tm1628_region_anns(region, state);
+	return count;
+}
+
+static ssize_t marquee_show(struct device *dev,
+			    struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	ssize_t len;
+
+	mutex_lock(&tm->anim_mutex);
+	len = sysfs_emit(buf, "%s\n", tm->marquee);
+	mutex_unlock(&tm->anim_mutex);
+	return len;
+}
+
+static ssize_t marquee_store(struct device *dev,
+			     struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	struct tm1628_anim_seq *seq;
+	char text[TM1628_MARQUEE_MAX + 2];	/* room for a newline */
+	int ret;
+
+	if (count > TM1628_MARQUEE_MAX + 1)
+		return -EINVAL;
+	memcpy(text, buf, count);
+	text[count] = '\0';
+	strim(text);
+	tm1628_activity(tm);
+	if (!*text) {
+		tm1628_anim_stop(tm);
+		return count;
+	}
+
+	seq = tm1628_marquee_build(tm, text);
+	if (!seq)
+		return -ENOMEM;
+	ret = tm1628_anim_play(tm, seq, text);
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(marquee);
+
+static ssize_t scroll_ms_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", tm->scroll_ms);
+}
+
+/* Takes effect with the next marquee written */
+static ssize_t scroll_ms_store(struct device *dev,
+			       struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+	if (!val || val > U16_MAX)
+		return -EINVAL;
+	WRITE_ONCE(tm->scroll_ms, val);
+	return count;
+}
+static DEVICE_ATTR_RW(scroll_ms);
+
+static ssize_t marquee_loops_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", tm->marquee_loops);
+}
+
+static ssize_t marquee_loops_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+	WRITE_ONCE(tm->marquee_loops, val);
+	return count;
+}
+static DEVICE_ATTR_RW(marquee_loops);
+
+static ssize_t displaymode_config_show(struct device *dev,
+				       struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", tm1628_layout(tm)->name);
+}
+
+static ssize_t displaymode_config_store(struct device *dev,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(tm1628_layouts); i++) {
+		if (sysfs_streq(buf, tm1628_layouts[i].name)) {
+			tm1628_activity(tm);
+			tm1628_set_mode(tm, i);
+			return count;
+		}
+	}
+	return -EINVAL;
+}
+static DEVICE_ATTR_RW(displaymode_config);
+
+static ssize_t annunciators_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	int grids = tm1628_layout(tm)->grids;
+	ssize_t len = 0;
+	int g;
+
+	for (g = 0; g < grids; g++)
+		len += sysfs_emit_at(buf, len, "0x%03x%c",
+				     READ_ONCE(tm->annunciators[g]),
+				     g + 1 < grids ? ' ' : '\n');
+	return len;
+}
+
+/*
+ * One bit mask per grid, bit n = SEG(n+1), separated by spaces; grids not
+ * listed are cleared. Only the segments above SEG8 that the current mode
+ * drives are used, and bits that a DT region claims are left unchanged.
+ */
+static ssize_t annunciators_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	u16 ann[TM1628_MAX_GRIDS] = { 0 };
+	char *copy, *cur, *tok;
+	int g = 0, ret = 0;
+
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!copy)
+		return -ENOMEM;
+	cur = strim(copy);
+	while ((tok = strsep(&cur, " \t")) != NULL) {
+		if (!*tok)
+			continue;
+		if (g == TM1628_MAX_GRIDS) {
+			ret = -EINVAL;
+			break;
+		}
+		ret = kstrtou16(tok, 0, &ann[g++]);
+		if (ret)
+			break;
+	}
+	kfree(copy);
+	if (ret)
+		return ret;
+
+	tm1628_activity(tm);
+	tm1628_set_annunciators(tm, ann);
+	return count;
+}
+static DEVICE_ATTR_RW(annunciators);
+
+static ssize_t max_fps_show(struct device *dev,
+			    struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", tm->max_fps);
+}
+
+static ssize_t max_fps_store(struct device *dev,
+			     struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+	tm->max_fps = min_t(unsigned int, val, HZ);
+	return count;
+}
+static DEVICE_ATTR_RW(max_fps);
+
+static ssize_t idle_display_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", tm1628_idle_displays[tm->idle_display]);
+}
+
+static ssize_t idle_display_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+	int i;
+
+	i = sysfs_match_string(tm1628_idle_displays, buf);
+	if (i < 0)
+		return i;
+	WRITE_ONCE(tm->idle_display, i);
+	/* Re-applied right away if already in standby */
+	tm1628_post(tm, TM1628_PEND_STANDBY);
+	return count;
+}
+static DEVICE_ATTR_RW(idle_display);
+
+static ssize_t label_show(struct device *dev,
+			  struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", tm->label);
+}
+static DEVICE_ATTR_RO(label);
+
+static ssize_t frames_show(struct device *dev,
+			   struct device_attribute *attr, char *buf)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%llu\n", READ_ONCE(tm->stats.frames));
+}
+static DEVICE_ATTR_RO(frames);
+
+static struct attribute *tm1628_attrs[] = {
+	&dev_attr_brightness.attr,
+	&dev_attr_time.attr,
+	&dev_attr_time_format.attr,
+	&dev_attr_date_format.attr,
+	&dev_attr_tz_offset_min.attr,
+	&dev_attr_display.attr,
+	&dev_attr_number.attr,
+	&dev_attr_displaymode_config.attr,
+	&dev_attr_max_fps.attr,
+	&dev_attr_idle_display.attr,
+	&dev_attr_label.attr,
+	&dev_attr_frames.attr,
+	&dev_attr_annunciators.attr,
+	&dev_attr_marquee.attr,
+	&dev_attr_scroll_ms.attr,
+	&dev_attr_marquee_loops.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(tm1628);
+
+static void tm1628_region_attr(struct device_attribute *attr, const char *name,
+		ssize_t (*show)(struct device *, struct device_attribute *, char *),
+		ssize_t (*store)(struct device *, struct device_attribute *,
+				 const char *, size_t))
+{
+	sysfs_attr_init(&attr->attr);
+	attr->attr.name = name;
+	attr->attr.mode = 0644;
+	attr->show = show;
+	attr->store = store;
+}
+
+/*
+ * Collect display regions from the DT child nodes:
+ *     weight {
+ *         label = "weight";                  (default: the node name)
+ *         titanmec,grids = <0 4>;            (first grid, grid count)
+ *         titanmec,annunciators = <0 9>, <1 9>;  (grid, SEG9-SEG14)
+ *     };
+ * Each becomes a region-<label> directory next to the common attributes.
+ * Bad nodes are reported and skipped.
+ */
+static int tm1628_regions_init(struct tm1628 *tm)
+{
+	struct device *dev = tm->dev;
+	struct fwnode_handle *child;
+	struct tm1628_region *region;
+	u32 grids[2], anns[2 * TM1628_REGION_ANNS];
+	int count, n, i;
+
+	count = device_get_child_node_count(dev);
+	if (!count)
+		return 0;
+	tm->regions = kcalloc(count, sizeof(*tm->regions), GFP_KERNEL);
+	tm->groups = kcalloc(count + 2, sizeof(*tm->groups), GFP_KERNEL);
+	if (!tm->regions || !tm->groups)
+		return -ENOMEM;
+	tm->groups[0] = &tm1628_group;
+
+	device_for_each_child_node(dev, child) {
+		region = &tm->regions[tm->num_regions];
+		if (fwnode_property_read_u32_array(child, "titanmec,grids",
+						   grids, 2) ||
+		    !grids[1] || grids[0] + grids[1] > TM1628_MAX_GRIDS) {
+			dev_warn(dev, "%pfwP: bad titanmec,grids\n", child);
+			continue;
+		}
+
+		n = fwnode_property_count_u32(child, "titanmec,annunciators");
+		if (n == -EINVAL)
+			n = 0;
+		if (n < 0 || n % 2 || n > ARRAY_SIZE(anns) ||
+		    (n && fwnode_property_read_u32_array(child,
+				"titanmec,annunciators", anns, n))) {
+			dev_warn(dev, "%pfwP: bad titanmec,annunciators\n", child);
+			continue;
+		}
+		for (i = 0; i < n / 2; i++) {
+			if (anns[2 * i] >= TM1628_MAX_GRIDS ||
+			    anns[2 * i + 1] < 9 || anns[2 * i + 1] > 14)
+				break;
+			region->anns[i].grid = anns[2 * i];
+			region->anns[i].bit = BIT(anns[2 * i + 1] - 1);
+		}
+		if (i < n / 2) {
+			dev_warn(dev, "%pfwP: bad titanmec,annunciators\n", child);
+			continue;
+		}
+
+		region->tm = tm;
+		region->first = grids[0];
+		region->count = grids[1];
+		region->num_anns = n / 2;
+		if (fwnode_property_read_string(child, "label", &region->name))
+			region->name = fwnode_get_name(child);
+		region->group.name = kasprintf(GFP_KERNEL, "region-%s",
+					       region->name);
+		if (!region->group.name) {
+			fwnode_handle_put(child);
+			return -ENOMEM;
+		}
+
+		tm1628_region_attr(&region->text_attr, "text",
+				   tm1628_region_text_show,
+				   tm1628_region_text_store);
+		tm1628_region_attr(&region->number_attr, "number",
+				   tm1628_region_number_show,
+				   tm1628_region_number_store);
+		tm1628_region_attr(&region->ann_attr, "annunciators",
+				   tm1628_region_ann_show,
+				   tm1628_region_ann_store);
+		region->attrs[0] = &region->text_attr.attr;
+		region->attrs[1] = &region->number_attr.attr;
+		region->attrs[2] = &region->ann_attr.attr;
+		region->group.attrs = region->attrs;
+		for (i = 0; i < region->num_anns; i++)
+			tm->region_anns[region->anns[i].grid] |= region->anns[i].bit;
+		tm->groups[++tm->num_regions] = &region->group;
+	}
+	return 0;
+}
+
+/* --- debugfs --- */
+
+static int tm1628_stats_show(struct seq_file *s, void *unused)
+{
+	struct tm1628 *tm = s->private;
+
+	seq_printf(s, "frames:     %llu\n", tm->stats.frames);
+	seq_printf(s, "bytes:      %llu\n", tm->stats.bytes);
+	seq_printf(s, "edges:      %llu\n", tm->stats.edges);
+	seq_printf(s, "busy_us:    %llu\n", div_u64(tm->stats.busy_ns, NSEC_PER_USEC));
+	seq_printf(s, "commands:   %llu\n", tm->stats.commands);
+	seq_printf(s, "key_scans:  %llu\n", tm->stats.key_scans);
+	seq_printf(s, "presses:    %llu\n", tm->stats.presses);
+	seq_printf(s, "coalesced:  %llu\n", tm->stats.coalesced);
+	seq_printf(s, "throttled:  %llu\n", tm->stats.throttled);
+	seq_printf(s, "errors:     %llu\n", tm->stats.errors);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(tm1628_stats);
+
+static void tm1628_hist_show(struct seq_file *s, const char *name,
+			     const struct tm1628_hist *h)
+{
+	unsigned int b;
+
+	seq_printf(s, "%s max_ns: %llu\n", name, h->max_ns);
+	for (b = 0; b < TM1628_HIST_BUCKETS; b++) {
+		if (!h->count[b])
+			continue;
+		if (!b)
+			seq_printf(s, "  %6s %6u us: %llu\n", "", 1, h->count[b]);
+		else if (b == TM1628_HIST_BUCKETS - 1)
+			seq_printf(s, "  %6u %6s us: %llu\n", 1U << (b - 1), "",
+				   h->count[b]);
+		else
+			seq_printf(s, "  %6u %6u us: %llu\n", 1U << (b - 1),
+				   1U << b, h->count[b]);
+	}
+}
+
+/*
+ * The longest atomic section is one group of bytes plus the STB edges
+ * around it, or the turnaround wait for the first bytes of a key read.
+ */
+static int tm1628_latency_show(struct seq_file *s, void *unused)
+{
+	struct tm1628 *tm = s->private;
+	unsigned int group = tm1628_atomic_group(tm);
+	u64 bound;
+
+	if (group) {
+		bound = (u64)group * 8 * (tm->timing.clk_low_ns +
+					  tm->timing.clk_high_ns) +
+			2 * tm->timing.stb_ns + tm->timing.wait_ns;
+		seq_printf(s, "atomic_bytes: %u (section bound %llu us)\n", group,
+			   div_u64(bound, NSEC_PER_USEC));
+	} else {
+		seq_puts(s, "atomic_bytes: 0\n");
+	}
+	tm1628_hist_show(s, "frame", &tm->lat.frame);
+	tm1628_hist_show(s, "gap", &tm->lat.gap);
+	return 0;
+}
+
+/* Any write starts a new measurement; a frame in flight may be half-counted */
+static ssize_t tm1628_latency_write(struct file *file, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct tm1628 *tm = s->private;
+
+	memset(&tm->lat.frame, 0, sizeof(tm->lat.frame));
+	memset(&tm->lat.gap, 0, sizeof(tm->lat.gap));
+	return count;
+}
+
+DEFINE_SHOW_STORE_ATTRIBUTE(tm1628_latency);
+
+/* --- Input Device --- */
+/*
+ * Build the keycode table from DT "linux,keymap" or the default keypad,
+ * then collect the populated matrix positions into tm->keys so that a
+ * scan only looks at, and only clocks in the bytes of, keys that exist.
+ */
+static int tm1628_keymap_init(struct tm1628 *tm, struct input_dev *input)
+{
+	const struct matrix_keymap_data *data = &tm1628_default_keymap_data;
+	unsigned int row, col, bit, code;
+	int ret;
+
+	if (device_property_present(tm->dev, "linux,keymap"))
+		data = NULL;
+
+	tm->keycodes = devm_kcalloc(tm->dev,
+				    TM1628_KEY_ROWS << TM1628_KEY_ROW_SHIFT,
+				    sizeof(*tm->keycodes), GFP_KERNEL);
+	tm->keys = devm_kcalloc(tm->dev, TM1628_KEY_ROWS * TM1628_KEY_COLS,
+				sizeof(*tm->keys), GFP_KERNEL);
+	if (!tm->keycodes || !tm->keys)
+		return -ENOMEM;
+
+	ret = matrix_keypad_build_keymap(data, NULL, TM1628_KEY_ROWS,
+					 TM1628_KEY_COLS, tm->keycodes, input);
+	if (ret) {
+		dev_err(tm->dev, "Invalid linux,keymap\n");
+		return ret;
+	}
+
+	for (col = 0; col < TM1628_KEY_COLS; col++) {
+		for (row = 0; row < TM1628_KEY_ROWS; row++) {
+			code = MATRIX_SCAN_CODE(row, col, TM1628_KEY_ROW_SHIFT);
+			if (tm->keycodes[code] == KEY_RESERVED)
+				continue;
+			bit = tm1628_key_bit(row, col);
+			tm->keys[tm->num_keys].bit = bit;
+			tm->keys[tm->num_keys].scancode = code;
+			tm->num_keys++;
+			tm->key_mask |= BIT_ULL(bit);
+			tm->key_bytes = max(tm->key_bytes, bit / 8 + 1);
+		}
+	}
+	dev_info(tm->dev, "%u keys, %u key bytes per scan\n",
+		 tm->num_keys, tm->key_bytes);
+	return 0;
+}
+
+static int tm1628_input_init(struct tm1628 *tm)
+{
+	struct input_dev *input;
+	int ret;
+
+	input = devm_input_allocate_device(tm->dev);
+	if (!input)
+		return -ENOMEM;
+
+	input->name = "TM1628 keypad";
+	input->phys = devm_kasprintf(tm->dev, GFP_KERNEL, "%s/input0", tm->name);
+	input->id.bustype = BUS_HOST;
+
+	ret = tm1628_keymap_init(tm, input);
+	if (ret)
+		return ret;
+	input_set_capability(input, EV_MSC, MSC_SCAN);
+	/* Let the input core generate autorepeat (value 2) events */
+	__set_bit(EV_REP, input->evbit);
+
+	/* Nothing to scan: no input device, and no key reads on the bus */
+	if (!tm->num_keys)
+		return 0;
+
+	ret = input_register_device(input);
+	if (ret)
+		return ret;
+	tm->input = input;
+	return 0;
+}
+
+/* --- Character Device --- */
+
+#define TM1628_EVENT_QUEUE	64	/* key events buffered per open file */
+
+/* Per-open state; every reader gets its own copy of each key event */
+struct tm1628_client {
+	struct tm1628 *tm;
+	struct list_head node;
+	spinlock_t lock;
+	DECLARE_KFIFO(events, struct tm1628_key_event, TM1628_EVENT_QUEUE);
+};
+
+static void tm1628_free(struct kref *ref)
+{
+	struct tm1628 *tm = container_of(ref, struct tm1628, ref);
+	unsigned int i;
+
+	for (i = 0; i < tm->num_regions; i++)
+		kfree(tm->regions[i].group.name);
+	kfree(tm->regions);
+	kfree(tm->groups);
+	kfree(tm->anim);
+	vfree(tm->fb);
+	ida_free(&tm1628_ida, tm->id);
+	kfree(tm);
+}
+
+static void tm1628_chardev_key_event(struct tm1628 *tm, u64 pressed,
+				     u64 released, ktime_t stamp)
+{
+	struct tm1628_key_event ev = {
+		.timestamp_ns = ktime_to_ns(stamp),
+		.down = tm->keyscan.down,
+		.pressed = pressed,
+		.released = released,
+	};
+	struct tm1628_client *client;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tm->clients_lock, flags);
+	list_for_each_entry(client, &tm->clients, node) {
+		spin_lock(&client->lock);
+		/* A reader that falls behind loses its oldest events */
+		if (kfifo_is_full(&client->events))
+			kfifo_skip(&client->events);
+		kfifo_put(&client->events, ev);
+		spin_unlock(&client->lock);
+	}
+	spin_unlock_irqrestore(&tm->clients_lock, flags);
+	wake_up_interruptible(&tm->key_wq);
+}
+
+static bool tm1628_client_empty(struct tm1628_client *client)
+{
+	unsigned long flags;
+	bool empty;
+
+	spin_lock_irqsave(&client->lock, flags);
+	empty = kfifo_is_empty(&client->events);
+	spin_unlock_irqrestore(&client->lock, flags);
+	return empty;
+}
+
+static int tm1628_open(struct inode *inode, struct file *file)
+{
+	/* misc_open() leaves the miscdevice here and holds misc_mtx */
+	struct tm1628 *tm = container_of(file->private_data,
+					 struct tm1628, misc);
+	struct tm1628_client *client;
+	unsigned long flags;
+
+	client = kzalloc(sizeof(*client), GFP_KERNEL);
+	if (!client)
+		return -ENOMEM;
+	client->tm = tm;
+	spin_lock_init(&client->lock);
+	INIT_KFIFO(client->events);
+	kref_get(&tm->ref);
+
+	spin_lock_irqsave(&tm->clients_lock, flags);
+	list_add_tail(&client->node, &tm->clients);
+	spin_unlock_irqrestore(&tm->clients_lock, flags);
+
+	file->private_data = client;
+	return nonseekable_open(inode, file);
+}
+
+static int tm1628_release(struct inode *inode, struct file *file)
+{
+	struct tm1628_client *client = file->private_data;
+	struct tm1628 *tm = client->tm;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tm->clients_lock, flags);
+	list_del(&client->node);
+	spin_unlock_irqrestore(&tm->clients_lock, flags);
+	kfree(client);
+	kref_put(&tm->ref, tm1628_free);
+	return 0;
+}
+
+static ssize_t tm1628_read(struct file *file, char __user *buf,
+			   size_t count, loff_t *ppos)
+{
+	struct tm1628_client *client = file->private_data;
+	struct tm1628 *tm = client->tm;
+	struct tm1628_key_event ev;
+	unsigned long flags;
+	size_t done = 0;
+	int ret;
+
+	if (count < sizeof(ev))
+		return -EINVAL;
+
+	while (tm1628_client_empty(client)) {
+		if (READ_ONCE(tm->dead))
+			return -ENODEV;
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(tm->key_wq,
+					       !tm1628_client_empty(client) ||
+					       READ_ONCE(tm->dead));
+		if (ret)
+			return ret;
+	}
+
+	while (done + sizeof(ev) <= count) {
+		spin_lock_irqsave(&client->lock, flags);
+		ret = kfifo_get(&client->events, &ev);
+		spin_unlock_irqrestore(&client->lock, flags);
+		if (!ret)
+			break;
+		if (copy_to_user(buf + done, &ev, sizeof(ev)))
+			return done ? done : -EFAULT;
+		done += sizeof(ev);
+	}
+	return done;
+}
+
+/*
+ * File ops that reach the worker or runtime PM run inside this pair, so
+ * remove cannot tear the device down under them once they passed the
+ * ->dead check.
+ */
+static int tm1628_ops_enter(struct tm1628 *tm)
+{
+	down_read(&tm->ops_rwsem);
+	if (tm->dead) {
+		up_read(&tm->ops_rwsem);
+		return -ENODEV;
+	}
+	return 0;
+}
+
+static void tm1628_ops_exit(struct tm1628 *tm)
+{
+	up_read(&tm->ops_rwsem);
+}
+
+/* A write is one complete display RAM frame */
+static ssize_t tm1628_write(struct file *file, const char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	struct tm1628_client *client = file->private_data;
+	unsigned char ram[TM1628_RAM_SIZE];
+	int ret;
+
+	if (count != TM1628_RAM_SIZE)
+		return -EINVAL;
+	if (copy_from_user(ram, buf, TM1628_RAM_SIZE))
+		return -EFAULT;
+	ret = tm1628_ops_enter(client->tm);
+	if (ret)
+		return ret;
+	tm1628_activity(client->tm);
+	tm1628_anim_stop(client->tm);
+	tm1628_display_ram(client->tm, ram);
+	tm1628_ops_exit(client->tm);
+	return count;
+}
+
+static __poll_t tm1628_poll(struct file *file, poll_table *wait)
+{
+	struct tm1628_client *client = file->private_data;
+	__poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+	poll_wait(file, &client->tm->key_wq, wait);
+	if (READ_ONCE(client->tm->dead))
+		return EPOLLHUP | EPOLLERR;
+	if (!tm1628_client_empty(client))
+		mask |= EPOLLIN | EPOLLRDNORM;
+	return mask;
+}
+
+static int tm1628_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct tm1628_client *client = file->private_data;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_SIZE)
+		return -EINVAL;
+	return remap_vmalloc_range(vma, client->tm->fb, 0);
+}
+
+static int tm1628_ioctl_anim_play(struct tm1628 *tm, void __user *argp)
+{
+	struct tm1628_anim_seq *seq;
+	struct tm1628_anim anim;
+	unsigned int i;
+
+	if (copy_from_user(&anim, argp, sizeof(anim)))
+		return -EFAULT;
+	if (!anim.count || anim.count > TM1628_ANIM_MAX_FRAMES)
+		return -EINVAL;
+
+	seq = tm1628_anim_alloc(anim.count, anim.loops);
+	if (!seq)
+		return -ENOMEM;
+	if (copy_from_user(seq->frames, u64_to_user_ptr(anim.frames),
+			   anim.count * sizeof(seq->frames[0]))) {
+		kfree(seq);
+		return -EFAULT;
+	}
+	/* A hold frame ends playback, so anything after it is unreachable */
+	for (i = 0; i + 1 < seq->count; i++)
+		if (!seq->frames[i].duration_ms)
+			break;
+	seq->count = i + 1;
+	return tm1628_anim_play(tm, seq, NULL);
+}
+
+static long tm1628_do_ioctl(struct tm1628 *tm, unsigned int cmd,
+			    unsigned long arg)
+{
+	unsigned char ram[TM1628_RAM_SIZE];
+
+	tm1628_activity(tm);
+	switch (cmd) {
+	case TM1628_IOC_COMMIT:
+		memcpy(ram, READ_ONCE(tm->fb)->ram, TM1628_RAM_SIZE);
+		tm1628_anim_stop(tm);
+		tm1628_display_ram(tm, ram);
+		return 0;
+	case TM1628_IOC_ANIM_PLAY:
+		return tm1628_ioctl_anim_play(tm, (void __user *)arg);
+	case TM1628_IOC_ANIM_STOP:
+		tm1628_anim_stop(tm);
+		return 0;
+	case TM1628_IOC_NUMBER: {
+		struct tm1628_number num;
+
+		if (copy_from_user(&num, (void __user *)arg, sizeof(num)))
+			return -EFAULT;
+		tm1628_anim_stop(tm);
+		return tm1628_display_number(tm, &num);
+	}
+	case TM1628_IOC_REGION_NUMBER: {
+		struct tm1628_region_number rn;
+
+		if (copy_from_user(&rn, (void __user *)arg, sizeof(rn)))
+			return -EFAULT;
+		if (rn.region >= tm->num_regions || rn.reserved)
+			return -EINVAL;
+		tm1628_anim_stop(tm);
+		return tm1628_region_number(&tm->regions[rn.region], &rn.number);
+	}
+	default:
+		return -ENOTTY;
+	}
+}
+
+static long tm1628_ioctl(struct file *file, unsigned int cmd,
+			 unsigned long arg)
+{
+	struct tm1628_client *client = file->private_data;
+	long ret;
+
+	ret = tm1628_ops_enter(client->tm);
+	if (ret)
+		return ret;
+	ret = tm1628_do_ioctl(client->tm, cmd, arg);
+	tm1628_ops_exit(client->tm);
+	return ret;
+}
+
+static const struct file_operations tm1628_fops = {
+	.owner = THIS_MODULE,
+	.open = tm1628_open,
+	.release = tm1628_release,
+	.read = tm1628_read,
+	.write = tm1628_write,
+	.poll = tm1628_poll,
+	.mmap = tm1628_mmap,
+	.unlocked_ioctl = tm1628_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+};
+
+/* --- Bus Transports --- */
+
+static int tm1628_gpio_init(struct tm1628 *tm)
+{
+	struct device *dev = tm->dev;
+
+	tm->stb = devm_gpiod_get(dev, "stb", GPIOD_OUT_HIGH);
+	if (IS_ERR(tm->stb)) {
+		dev_err(dev, "Failed to get STB GPIO\n");
+		return PTR_ERR(tm->stb);
+	}
+	tm->dio = devm_gpiod_get(dev, "dio", GPIOD_OUT_HIGH);
+	if (IS_ERR(tm->dio)) {
+		dev_err(dev, "Failed to get DIO GPIO\n");
+		return PTR_ERR(tm->dio);
+	}
+	tm->dio_level = 1;
+	tm->clk = devm_gpiod_get(dev, "clk", GPIOD_OUT_HIGH);
+	if (IS_ERR(tm->clk)) {
+		dev_err(dev, "Failed to get CLK GPIO\n");
+		return PTR_ERR(tm->clk);
+	}
+	tm->bus_descs[0] = tm->clk;
+	tm->bus_descs[1] = tm->dio;
+	tm->atomic_ok = !gpiod_cansleep(tm->stb) && !gpiod_cansleep(tm->dio) &&
+			!gpiod_cansleep(tm->clk);
+	if (!tm->atomic_ok && atomic_bytes)
+		dev_warn(dev, "GPIOs can sleep, atomic_bytes ignored\n");
+
+	tm1628_setup_timing(tm);
+	return 0;
+}
+
+static const struct tm1628_bus tm1628_gpio_bus = {
+	.name = "gpio",
+	.init = tm1628_gpio_init,
+	.write = tm1628_gpio_write,
+	.read = tm1628_gpio_read,
+};
+
+#if IS_ENABLED(CONFIG_SPI_MASTER)
+static void tm1628_spi_done(struct tm1628 *tm, unsigned int bytes, int ret)
+{
+	if (ret) {
+		tm->stats.errors++;
+		dev_err_ratelimited(tm->dev, "SPI transfer failed: %d\n", ret);
+		return;
+	}
+	/* What the controller drove: two CLK edges per bit, STB low and high */
+	tm->stats.bytes += bytes;
+	tm->stats.edges += 16 * bytes + 2;
+}
+
+static u8 tm1628_spi_byte(struct tm1628 *tm, u8 b)
+{
+	return tm->spi_bitrev ? bitrev8(b) : b;
+}
+
+static void tm1628_spi_write(struct tm1628 *tm, const u8 *data,
+			     unsigned int len)
+{
+	struct spi_transfer xfer = { .tx_buf = tm->spi_buf, .len = len };
+	unsigned int i;
+	u64 start;
+	int ret;
+
+	for (i = 0; i < len; i++)
+		tm->spi_buf[i] = tm1628_spi_byte(tm, data[i]);
+	start = ktime_get_ns();
+	ret = spi_sync_transfer(tm->spi, &xfer, 1);
+	tm1628_hist_add(&tm->lat.frame, ktime_get_ns() - start);
+	tm1628_spi_done(tm, len, ret);
+}
+
+/* Command, then the line turns around after the wait time for the reply */
+static void tm1628_spi_read(struct tm1628 *tm, u8 cmd, u8 *data,
+			    unsigned int len)
+{
+	struct spi_transfer xfers[2] = {
+		{
+			.tx_buf = tm->spi_buf,
+			.len = 1,
+			.delay = {
+				.value = TM1628_MIN_WAIT_NS,
+				.unit = SPI_DELAY_UNIT_NSECS,
+			},
+		},
+		{ .rx_buf = tm->spi_buf + 1, .len = len },
+	};
+	unsigned int i;
+	u64 start;
+	int ret;
+
+	tm->spi_buf[0] = tm1628_spi_byte(tm, cmd);
+	start = ktime_get_ns();
+	ret = spi_sync_transfer(tm->spi, xfers, ARRAY_SIZE(xfers));
+	tm1628_hist_add(&tm->lat.frame, ktime_get_ns() - start);
+	for (i = 0; i < len; i++)
+		data[i] = ret ? 0 : tm1628_spi_byte(tm, tm->spi_buf[1 + i]);
+	tm1628_spi_done(tm, 1 + len, ret);
+}
+
+/* Keep STB timing from DT (spi-cs-*-delay-ns), else use the datasheet's */
+static void tm1628_spi_default_delay(struct spi_delay *delay)
+{
+	if (delay->value)
+		return;
+	delay->value = TM1628_MIN_PW_STB_NS;
+	delay->unit = SPI_DELAY_UNIT_NSECS;
+}
+
+/*
+ * The chip clocks data LSB first, CLK idles high and DIO is sampled on
+ * the rising edge (mode 3), on one bidirectional data line. A controller
+ * without LSB-first support gets bit-reversed bytes instead.
+ */
+static int tm1628_spi_init(struct tm1628 *tm)
+{
+	struct spi_device *spi = to_spi_device(tm->dev);
+	int ret;
+
+	tm->spi = spi;
+	tm->spi_buf = devm_kzalloc(tm->dev, 1 + TM1628_RAM_SIZE, GFP_KERNEL);
+	if (!tm->spi_buf)
+		return -ENOMEM;
+
+	spi->mode |= SPI_MODE_3 | SPI_3WIRE;
+	if (spi->controller->mode_bits & SPI_LSB_FIRST)
+		spi->mode |= SPI_LSB_FIRST;
+	else
+		tm->spi_bitrev = true;
+	spi->bits_per_word = 8;
+	if (!spi->max_speed_hz || spi->max_speed_hz > TM1628_MAX_CLK_HZ)
+		spi->max_speed_hz = TM1628_MAX_CLK_HZ;
+	tm1628_spi_default_delay(&spi->cs_setup);
+	tm1628_spi_default_delay(&spi->cs_hold);
+	tm1628_spi_default_delay(&spi->cs_inactive);
+
+	ret = spi_setup(spi);
+	if (ret) {
+		dev_err(tm->dev, "Failed to set up SPI: %d\n", ret);
+		return ret;
+	}
+	dev_info(tm->dev, "bus SPI %u Hz%s\n", spi->max_speed_hz,
+		 tm->spi_bitrev ? ", LSB first in software" : "");
+	return 0;
+}
+
+static const struct tm1628_bus tm1628_spi_bus = {
+	.name = "spi",
+	.init = tm1628_spi_init,
+	.write = tm1628_spi_write,
+	.read = tm1628_spi_read,
+};
+#endif
+
+/* --- Probe and Remove, shared by the platform and SPI drivers --- */
+static int tm1628_probe_common(struct device *dev, const struct tm1628_bus *bus)
+{
+	struct tm1628 *tm;
+	int ret;
+
+	/*
+	 * Not devm: open files keep the instance alive past remove(), so it
+	 * is refcounted and freed by the last tm1628_free().
+	 */
+	tm = kzalloc(sizeof(*tm), GFP_KERNEL);
+	if (!tm)
+		return -ENOMEM;
+	kref_init(&tm->ref);
+	tm->dev = dev;
+	tm->id = ida_alloc(&tm1628_ida, GFP_KERNEL);
+	if (tm->id < 0) {
+		ret = tm->id;
+		kfree(tm);
+		return ret;
+	}
+	snprintf(tm->name, sizeof(tm->name), DRIVER_NAME "-%d", tm->id);
+	if (device_property_read_string(dev, "label", &tm->label))
+		tm->label = dev_name(dev);
+
+	tm->brightness = 10;
+	tm->mode_cmd = 0x02;
+	tm->max_fps = 60;
+	spin_lock_init(&tm->mbox_lock);
+	INIT_LIST_HEAD(&tm->clients);
+	spin_lock_init(&tm->clients_lock);
+	init_waitqueue_head(&tm->key_wq);
+	mutex_init(&tm->anim_mutex);
+	init_rwsem(&tm->ops_rwsem);
+	hrtimer_init(&tm->anim_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	tm->anim_timer.function = tm1628_anim_step;
+	hrtimer_init(&tm->time_timer, CLOCK_REALTIME, HRTIMER_MODE_ABS);
+	tm->time_timer.function = tm1628_time_tick;
+	tm->scroll_ms = 250;
+
+	tm->fb = vmalloc_user(PAGE_SIZE);
+	if (!tm->fb) {
+		ret = -ENOMEM;
+		goto fail_put;
+	}
+
+	tm->bus = bus;
+	ret = bus->init(tm);
+	if (ret)
+		goto fail_put;
+
+	tm->worker = kthread_create_worker(0, "%s", tm->name);
+	if (IS_ERR(tm->worker)) {
+		dev_err(dev, "Failed to create kthread worker\n");
+		ret = PTR_ERR(tm->worker);
+		goto fail_put;
+	}
+	kthread_init_delayed_work(&tm->commit_work, tm1628_commit_work);
+	kthread_init_delayed_work(&tm->scan_work, tm1628_scan_work);
+	kthread_init_work(&tm->time_work, tm1628_time_work);
+	kthread_init_work(&tm->anim_work, tm1628_anim_work);
+	tm1628_worker_setup(tm);
+
+	tm1628_init_display(tm);
+	tm->next_commit = jiffies;
+
+	ret = tm1628_input_init(tm);
+	if (ret) {
+		dev_err(dev, "Failed to register input device\n");
+		goto fail_worker;
+	}
+
+	tm->misc.minor = MISC_DYNAMIC_MINOR;
+	tm->misc.name = tm->name;
+	tm->misc.fops = &tm1628_fops;
+	tm->misc.parent = dev;
+	ret = misc_register(&tm->misc);
+	if (ret) {
+		dev_err(dev, "Failed to register misc device\n");
+		goto fail_worker;
+	}
+
+	ret = tm1628_regions_init(tm);
+	if (ret)
+		goto fail_misc;
+
+	tm->class_dev = device_create_with_groups(auxdisplay_class, dev,
+						  MKDEV(0, 0), tm,
+						  tm->groups ?: tm1628_groups,
+						  "%s", tm->name);
+	if (IS_ERR(tm->class_dev)) {
+		dev_err(dev, "Failed to create sysfs device\n");
+		ret = PTR_ERR(tm->class_dev);
+		goto fail_misc;
+	}
+
+	/* debugfs is optional, failures are ignored */
+	tm->debugfs = debugfs_create_dir(tm->name, tm1628_debugfs_root);
+	debugfs_create_file("stats", 0444, tm->debugfs, tm, &tm1628_stats_fops);
+	debugfs_create_file("latency", 0644, tm->debugfs, tm, &tm1628_latency_fops);
+
+	tm1628_play_splash(tm);
+
+	dev_set_drvdata(dev, tm);
+
+	pm_runtime_set_active(dev);
+	pm_runtime_set_autosuspend_delay(dev, TM1628_AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_enable(dev);
+	tm1628_activity(tm);
+
+	tm->keyscan.interval_ms = scan_idle_ms;
+	tm->last_key_jiffies = jiffies;
+	kthread_queue_delayed_work(tm->worker, &tm->scan_work, 0);
+
+	dev_info(dev, "TM1628 %s (%s) loaded successfully\n",
+		 tm->name, tm->label);
+	return 0;
+
+fail_misc:
+	misc_deregister(&tm->misc);
+fail_worker:
+	tm1628_set_dead(tm);
+	tm1628_stop_worker(tm);
+fail_put:
+	kref_put(&tm->ref, tm1628_free);
+	return ret;
+}
+
+static void tm1628_remove_common(struct device *dev)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	/* Stop producers first, then the worker that owns the bus */
+	pm_runtime_disable(dev);
+	pm_runtime_dont_use_autosuspend(dev);
+	debugfs_remove_recursive(tm->debugfs);
+	device_unregister(tm->class_dev);
+	misc_deregister(&tm->misc);
+
+	/*
+	 * Orphaned files see ->dead once running file ops have drained; the
+	 * player refuses to restart
+	 */
+	down_write(&tm->ops_rwsem);
+	mutex_lock(&tm->anim_mutex);
+	tm1628_set_dead(tm);
+	hrtimer_cancel(&tm->anim_timer);
+	mutex_unlock(&tm->anim_mutex);
+	up_write(&tm->ops_rwsem);
+	hrtimer_cancel(&tm->time_timer);
+	wake_up_interruptible(&tm->key_wq);
+
+	tm1628_stop_worker(tm);
+
+	dev_info(dev, "TM1628 %s unloaded\n", tm->name);
+	kref_put(&tm->ref, tm1628_free);
+}
+
+/*
+ * Runtime PM only flips the standby flag; the worker applies it, since it
+ * is the only code allowed on the bus
+ */
+static int tm1628_runtime_suspend(struct device *dev)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	WRITE_ONCE(tm->standby, true);
+	tm1628_post(tm, TM1628_PEND_STANDBY);
+	return 0;
+}
+
+static int tm1628_runtime_resume(struct device *dev)
+{
+	struct tm1628 *tm = dev_get_drvdata(dev);
+
+	WRITE_ONCE(tm->standby, false);
+	tm1628_post(tm, TM1628_PEND_STANDBY);
+	return 0;
+}
+
+static DEFINE_RUNTIME_DEV_PM_OPS(tm1628_pm_ops, tm1628_runtime_suspend,
+				 tm1628_runtime_resume, NULL);
+
+static const struct of_device_id tm1628_of_match[] = {
+	{ .compatible = "titanmec,tm1628", },
+	{ },
+};
+MODULE_DEVICE_TABLE(of, tm1628_of_match);
+
+static int tm1628_probe(struct platform_device *pdev)
+{
+	return tm1628_probe_common(&pdev->dev, &tm1628_gpio_bus);
+}
+
+static int tm1628_remove(struct platform_device *pdev)
+{
+	tm1628_remove_common(&pdev->dev);
+	return 0;
+}
+
+static struct platform_driver tm1628_driver = {
+	.driver = {
+		.name = DRIVER_NAME,
+		.of_match_table = tm1628_of_match,
+		.pm = pm_ptr(&tm1628_pm_ops),
+	},
+	.probe = tm1628_probe,
+	.remove = tm1628_remove,
+};
+
+#if IS_ENABLED(CONFIG_SPI_MASTER)
+static int tm1628_spi_probe(struct spi_device *spi)
+{
+	return tm1628_probe_common(&spi->dev, &tm1628_spi_bus);
+}
+
+static void tm1628_spi_remove(struct spi_device *spi)
+{
+	tm1628_remove_common(&spi->dev);
+}
+
+static const struct spi_device_id tm1628_spi_ids[] = {
+	{ "tm1628", },
+	{ },
+};
+MODULE_DEVICE_TABLE(spi, tm1628_spi_ids);
+
+static struct spi_driver tm1628_spi_driver = {
+	.driver = {
+		.name = DRIVER_NAME,
+		.of_match_table = tm1628_of_match,
+		.pm = pm_ptr(&tm1628_pm_ops),
+	},
+	.probe = tm1628_spi_probe,
+	.remove = tm1628_spi_remove,
+	.id_table = tm1628_spi_ids,
+};
+
+static int tm1628_spi_register(void)
+{
+	return spi_register_driver(&tm1628_spi_driver);
+}
+
+static void tm1628_spi_unregister(void)
+{
+	spi_unregister_driver(&tm1628_spi_driver);
+}
+#else
+static inline int tm1628_spi_register(void)
+{
+	return 0;
+}
+
+static inline void tm1628_spi_unregister(void)
+{
+}
+#endif
+
+/*
+ * The class and the debugfs root are shared by all instances, so they live
+ * as long as the module
+ */
+static int __init tm1628_module_init(void)
+{
+	int ret;
+
+	auxdisplay_class = class_create("auxdisplay");
+	if (IS_ERR(auxdisplay_class))
+		return PTR_ERR(auxdisplay_class);
+	tm1628_debugfs_root = debugfs_create_dir("tm1628", NULL);
+
+	ret = platform_driver_register(&tm1628_driver);
+	if (ret)
+		goto fail_class;
+	ret = tm1628_spi_register();
+	if (ret) {
+		platform_driver_unregister(&tm1628_driver);
+		goto fail_class;
+	}
+	return 0;
+
+fail_class:
+	debugfs_remove_recursive(tm1628_debugfs_root);
+	class_destroy(auxdisplay_class);
+	return ret;
+}
+module_init(tm1628_module_init);
+
+static void __exit tm1628_module_exit(void)
+{
+	tm1628_spi_unregister();
+	platform_driver_unregister(&tm1628_driver);
+	debugfs_remove_recursive(tm1628_debugfs_root);
+	class_destroy(auxdisplay_class);
+}
+module_exit(tm1628_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Your Name");
+MODULE_DESCRIPTION("TM1628 LED Display Platform Driver with Integrated Key Scanning and Time Mode");
@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * tm1628_ioctl.h - Userspace interface of the /dev/tm1628-N character devices
+ *
+ *   write()  one raw frame of exactly TM1628_RAM_BYTES bytes, the chip's
+ *            display RAM image (even byte = SEG1-SEG8, odd = SEG9-SEG14
+ *            of each grid)
+ *   mmap()   one page holding a struct tm1628_fb; TM1628_IOC_COMMIT posts
+ *            its current contents as the next frame
+ *   read()   struct tm1628_key_event records, one per key state change;
+ *            blocks unless O_NONBLOCK, poll() reports EPOLLIN when ready
+ *   TM1628_IOC_ANIM_PLAY  upload a frame sequence and play it in the
+ *            driver; any other display write stops it
+ *   TM1628_IOC_NUMBER  show a fixed-point number, rendered by the driver
+ *   TM1628_IOC_REGION_NUMBER  the same for one DT display region only
+ */
+#ifndef _TM1628_IOCTL_H
+#define _TM1628_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define TM1628_RAM_BYTES	14
+#define TM1628_MAX_GRIDS	7
+
+/* Layout of the mmap()ed framebuffer */
+struct tm1628_fb {
+	__u8 ram[TM1628_RAM_BYTES];
+};
+
+/* Key bitmaps use bit (byte * 8 + bit) of the 5 key scan bytes */
+struct tm1628_key_event {
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC time of the key read */
+	__u64 down;		/* all keys down after this change */
+	__u64 pressed;		/* keys that went down */
+	__u64 released;		/* keys that went up */
+};
+
+/*
+ * One animation frame: a pattern per grid, bit n = SEG(n+1), laid out for
+ * the current display mode like rendered text. duration_ms 0 holds the
+ * frame and ends playback.
+ */
+struct tm1628_anim_frame {
+	__u16 grids[TM1628_MAX_GRIDS];
+	__u16 duration_ms;
+};
+
+#define TM1628_ANIM_MAX_FRAMES	1024
+
+struct tm1628_anim {
+	__u32 count;		/* frames, 1..TM1628_ANIM_MAX_FRAMES */
+	__u32 loops;		/* times to play the sequence, 0 = forever */
+	__u64 frames;		/* user pointer to count tm1628_anim_frame */
+};
+
+/*
+ * A fixed-point number: value / 10^decimals, right-aligned on the grids
+ * of the current mode, e.g. { 699909, 2 } shows "6999.09".
+ */
+struct tm1628_number {
+	__s64 value;
+	__u8 decimals;		/* digits after the point, below the grid count */
+	__u8 flags;
+	__u8 reserved[6];	/* must be zero */
+};
+
+#define TM1628_NUM_BLANK_ZEROS	0x01	/* blank zeros left of the units digit */
+#define TM1628_NUM_MINUS	0x02	/* minus sign even for 0, e.g. "-0.00" */
+#define TM1628_NUM_OVERFLOW	0x04	/* dashes instead of the value */
+#define TM1628_NUM_FLAGS	0x07
+
+/* A number for one display region, numbered in DT child node order */
+struct tm1628_region_number {
+	__u32 region;
+	__u32 reserved;		/* must be zero */
+	struct tm1628_number number;
+};
+
+#define TM1628_IOC_MAGIC	'T'
+
+/* Commit the mmap()ed framebuffer */
+#define TM1628_IOC_COMMIT	_IO(TM1628_IOC_MAGIC, 0x00)
+/* Replace the running animation, if any, and start playing */
+#define TM1628_IOC_ANIM_PLAY	_IOW(TM1628_IOC_MAGIC, 0x01, struct tm1628_anim)
+#define TM1628_IOC_ANIM_STOP	_IO(TM1628_IOC_MAGIC, 0x02)
+/* Stop the player and show a number; EINVAL for bad decimals or flags */
+#define TM1628_IOC_NUMBER	_IOW(TM1628_IOC_MAGIC, 0x03, struct tm1628_number)
+/* Show a number in one region, leaving the rest of the display as it is */
+#define TM1628_IOC_REGION_NUMBER \
+	_IOW(TM1628_IOC_MAGIC, 0x04, struct tm1628_region_number)
+
+#endif /* _TM1628_IOCTL_H */
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * tm1628_trace.h - Tracepoints for the TM1628 bus
+ *
+ * Each event covers one bus operation of the kthread worker and carries the
+ * bytes it clocked and how long the CPU was busy bit-banging it:
+ *
+ *   # echo 1 > /sys/kernel/tracing/events/tm1628/enable
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tm1628
+
+#if !defined(_TM1628_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TM1628_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* A display RAM update, first..first+span-1 of which went out */
+TRACE_EVENT(tm1628_frame,
+	TP_PROTO(const char *name, int first, int span, unsigned int bytes,
+		 u64 duration_ns),
+	TP_ARGS(name, first, span, bytes, duration_ns),
+
+	TP_STRUCT__entry(
+		__string(name, name)
+		__field(int, first)
+		__field(int, span)
+		__field(unsigned int, bytes)
+		__field(u64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, name);
+		__entry->first = first;
+		__entry->span = span;
+		__entry->bytes = bytes;
+		__entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("%s ram %d+%d bytes=%u duration=%lluns", __get_str(name),
+		  __entry->first, __entry->span, __entry->bytes,
+		  __entry->duration_ns)
+);
+
+/* Display mode or display control (brightness) commands */
+TRACE_EVENT(tm1628_command,
+	TP_PROTO(const char *name, u8 cmd, unsigned int bytes, u64 duration_ns),
+	TP_ARGS(name, cmd, bytes, duration_ns),
+
+	TP_STRUCT__entry(
+		__string(name, name)
+		__field(u8, cmd)
+		__field(unsigned int, bytes)
+		__field(u64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, name);
+		__entry->cmd = cmd;
+		__entry->bytes = bytes;
+		__entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("%s cmd=0x%02x bytes=%u duration=%lluns", __get_str(name),
+		  __entry->cmd, __entry->bytes, __entry->duration_ns)
+);
+
+/* One key scan: the raw key bitmap read and the debounced changes */
+TRACE_EVENT(tm1628_key_scan,
+	TP_PROTO(const char *name, u64 raw, u64 pressed, u64 released,
+		 u64 duration_ns),
+	TP_ARGS(name, raw, pressed, released, duration_ns),
+
+	TP_STRUCT__entry(
+		__string(name, name)
+		__field(u64, raw)
+		__field(u64, pressed)
+		__field(u64, released)
+		__field(u64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, name);
+		__entry->raw = raw;
+		__entry->pressed = pressed;
+		__entry->released = released;
+		__entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("%s raw=0x%llx pressed=0x%llx released=0x%llx duration=%lluns",
+		  __get_str(name), __entry->raw, __entry->pressed,
+		  __entry->released, __entry->duration_ns)
+);
+
+#endif /* _TM1628_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE tm1628_trace
+#include <trace/define_trace.h>
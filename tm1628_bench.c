@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdint.h>
+#include <libgen.h>
+#include "Kernel_Driver_tm1628/tm1628_ioctl.h"
+
+// Benchmarks for the tm1628 kernel driver.
+//
+// Runs against a real instance or one whose GPIOs are gpio-sim lines (see
+// tm1628_emu.c for watching that bus). Every result is printed as one JSON
+// object on stdout, latencies in microseconds, so runs of different driver
+// versions can be compared with jq or a script; progress goes to stderr.
+//
+//   fps    frames per second through the display attribute, with the frame
+//          rate limit lifted: writes/s accepted and frames/s reaching the bus
+//   sysfs  latency distribution of display and brightness writes
+//   time   offset of the time mode frames from the wall-clock second
+//   key    gpio-sim only: pulls DIO up so every key reads as pressed and
+//          measures the time to the key event on /dev/tm1628-N and to the
+//          echoed frame (needs the key_echo module parameter)
+//
+// Frames are counted through the driver's "frames" attribute, which is
+// polled, so frame times are accurate to the poll interval (-p).
+//
+// Build:
+//   gcc -O2 -o tm1628_bench tm1628_bench.c
+//
+// Usage: tm1628_bench [-D sysfs_dir] [-c chardev] [-t fps,sysfs,time,key] [-n writes]
+//                     [-T secs] [-s gpiochip_dir] [-o dio_offset] [-r presses] [-p poll_us]
+
+struct bench_config {
+    const char *dir;
+    const char *chardev;
+    const char *tests;
+    int writes;
+    int time_secs;
+    const char *sim_dir;
+    unsigned int dio_offset;
+    int presses;
+    unsigned int poll_us;
+};
+
+static struct bench_config config = {
+    .dir = "/sys/class/auxdisplay/tm1628-0",
+    .tests = "fps,sysfs,time,key",
+    .writes = 1000,
+    .time_secs = 5,
+    .dio_offset = 19,
+    .presses = 20,
+    .poll_us = 200,
+};
+
+static uint64_t now_ns(clockid_t clk) {
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_us(unsigned int us) {
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000L };
+
+    nanosleep(&ts, NULL);
+}
+
+// --- sysfs helpers ---
+
+static int attr_open(const char *name, int flags) {
+    char path[512];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", config.dir, name);
+    fd = open(path, flags);
+    if (fd < 0)
+        perror(path);
+    return fd;
+}
+
+static int attr_write(const char *name, const char *val) {
+    int fd = attr_open(name, O_WRONLY);
+    int ret;
+
+    if (fd < 0)
+        return -1;
+    ret = write(fd, val, strlen(val)) < 0 ? -1 : 0;
+    if (ret < 0)
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+    close(fd);
+    return ret;
+}
+
+static int attr_read(const char *name, char *buf, size_t len) {
+    int fd = attr_open(name, O_RDONLY);
+    ssize_t n;
+
+    if (fd < 0)
+        return -1;
+    n = read(fd, buf, len - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+// The frames attribute, kept open and re-read with pread()
+static int frames_fd = -1;
+
+static long frames_read(void) {
+    char buf[32];
+    ssize_t n = pread(frames_fd, buf, sizeof(buf) - 1, 0);
+
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+    return atol(buf);
+}
+
+// Poll the frame counter until it moves past 'from'; returns the time it did
+// or 0 after timeout_ms
+static uint64_t frames_wait(long from, clockid_t clk, unsigned int timeout_ms) {
+    uint64_t end = now_ns(CLOCK_MONOTONIC) + timeout_ms * 1000000ull;
+
+    while (now_ns(CLOCK_MONOTONIC) < end) {
+        if (frames_read() > from)
+            return now_ns(clk);
+        sleep_us(config.poll_us);
+    }
+    return 0;
+}
+
+// --- Statistics ---
+
+struct samples {
+    double *v;      // microseconds
+    int n, size;
+};
+
+static void samples_add(struct samples *s, double us) {
+    if (s->n == s->size) {
+        s->size = s->size ? s->size * 2 : 256;
+        s->v = realloc(s->v, s->size * sizeof(*s->v));
+        if (!s->v) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    s->v[s->n++] = us;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double percentile(const struct samples *s, double p) {
+    return s->v[(int)(p / 100.0 * (s->n - 1) + 0.5)];
+}
+
+// Print "name": {count, min, mean, p50, p90, p99, max} and free the samples
+static void print_stats(const char *name, struct samples *s, int last) {
+    double sum = 0;
+
+    printf("    \"%s\": {\"count\": %d", name, s->n);
+    if (s->n) {
+        qsort(s->v, s->n, sizeof(*s->v), cmp_double);
+        for (int i = 0; i < s->n; i++)
+            sum += s->v[i];
+        printf(", \"min\": %.1f, \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+               "\"p99\": %.1f, \"max\": %.1f", s->v[0], sum / s->n,
+               percentile(s, 50), percentile(s, 90), percentile(s, 99), s->v[s->n - 1]);
+    }
+    printf("}%s\n", last ? "" : ",");
+    free(s->v);
+    *s = (struct samples){ 0 };
+}
+
+// --- Tests ---
+
+static int timed_write(int fd, const char *val, struct samples *lat) {
+    uint64_t t = now_ns(CLOCK_MONOTONIC);
+
+    if (pwrite(fd, val, strlen(val), 0) < 0) {
+        perror("write");
+        return -1;
+    }
+    samples_add(lat, (now_ns(CLOCK_MONOTONIC) - t) / 1e3);
+    return 0;
+}
+
+static int bench_fps(void) {
+    int fd = attr_open("display", O_WRONLY);
+    struct samples lat = { 0 };
+    char old_fps[32], val[16];
+    uint64_t start, end, last_change;
+    long f0, f, prev;
+
+    if (fd < 0 || attr_read("max_fps", old_fps, sizeof(old_fps)) < 0 ||
+        attr_write("max_fps", "0") < 0)
+        return -1;
+
+    fprintf(stderr, "fps: %d display writes\n", config.writes);
+    f0 = frames_read();
+    start = now_ns(CLOCK_MONOTONIC);
+    for (int i = 0; i < config.writes; i++) {
+        snprintf(val, sizeof(val), "%08d", i * 1111 % 100000000);
+        if (timed_write(fd, val, &lat) < 0)
+            break;
+    }
+    end = now_ns(CLOCK_MONOTONIC);
+
+    // Let the thread drain the mailbox; the last change marks the end
+    last_change = end;
+    prev = frames_read();
+    while (now_ns(CLOCK_MONOTONIC) - last_change < 100000000ull) {
+        sleep_us(config.poll_us);
+        f = frames_read();
+        if (f != prev) {
+            prev = f;
+            last_change = now_ns(CLOCK_MONOTONIC);
+        }
+    }
+    close(fd);
+    attr_write("max_fps", old_fps);
+
+    printf("  \"fps\": {\"writes\": %d, \"frames\": %ld, \"writes_per_s\": %.1f, "
+           "\"frames_per_s\": %.1f,\n", lat.n, prev - f0,
+           lat.n / ((end - start) / 1e9), (prev - f0) / ((last_change - start) / 1e9));
+    print_stats("write_us", &lat, 1);
+    printf("  },\n");
+    return 0;
+}
+
+static int bench_sysfs(void) {
+    int dfd = attr_open("display", O_WRONLY);
+    int bfd = attr_open("brightness", O_WRONLY);
+    struct samples disp = { 0 }, bright = { 0 };
+    char old_bright[32], val[16];
+
+    if (dfd < 0 || bfd < 0 || attr_read("brightness", old_bright, sizeof(old_bright)) < 0)
+        return -1;
+
+    // Paced well below the frame rate, so each write finds an idle driver
+    fprintf(stderr, "sysfs: %d display and brightness writes\n", config.writes);
+    for (int i = 0; i < config.writes; i++) {
+        snprintf(val, sizeof(val), "%08d", i);
+        if (timed_write(dfd, val, &disp) < 0)
+            break;
+        snprintf(val, sizeof(val), "%d", 8 + i % 8);
+        if (timed_write(bfd, val, &bright) < 0)
+            break;
+        sleep_us(2000);
+    }
+    close(dfd);
+    close(bfd);
+    attr_write("brightness", old_bright);
+
+    printf("  \"sysfs_us\": {\n");
+    print_stats("display", &disp, 0);
+    print_stats("brightness", &bright, 1);
+    printf("  },\n");
+    return 0;
+}
+
+static int bench_time(void) {
+    struct samples off = { 0 };
+    char state[16];
+    uint64_t end, t;
+    long f;
+
+    fprintf(stderr, "time: %d s of time mode\n", config.time_secs);
+    if (attr_write("time", "on") < 0)
+        return -1;
+    // The driver ignores values it does not know, so check it took effect
+    if (attr_read("time", state, sizeof(state)) < 0 || strcmp(state, "on") != 0) {
+        fprintf(stderr, "time: time mode did not turn on\n");
+        return -1;
+    }
+    // The first frame is drawn as soon as time mode is enabled
+    f = frames_read();
+    frames_wait(f, CLOCK_REALTIME, 1000);
+
+    end = now_ns(CLOCK_MONOTONIC) + config.time_secs * 1000000000ull;
+    while (now_ns(CLOCK_MONOTONIC) < end) {
+        f = frames_read();
+        t = frames_wait(f, CLOCK_REALTIME, 1500);
+        if (!t)
+            break;
+        // Offset from the nearest second boundary
+        t %= 1000000000ull;
+        samples_add(&off, t < 500000000ull ? t / 1e3 : -((1000000000ull - t) / 1e3));
+    }
+    attr_write("time", "off");
+
+    printf("  \"time_offset_us\": {\n");
+    print_stats("offset", &off, 1);
+    printf("  },\n");
+    if (!off.n) {
+        fprintf(stderr, "time: no time mode frames seen\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int sim_pull(int fd, int up) {
+    const char *v = up ? "pull-up" : "pull-down";
+
+    return pwrite(fd, v, strlen(v), 0) < 0 ? -1 : 0;
+}
+
+// Wait for a key event with the given press state; returns its timestamp
+static uint64_t key_event_wait(int fd, int pressed) {
+    struct tm1628_key_event ev;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    while (poll(&pfd, 1, 1000) > 0) {
+        if (read(fd, &ev, sizeof(ev)) != sizeof(ev))
+            return 0;
+        if (pressed ? ev.pressed != 0 : ev.down == 0)
+            return ev.timestamp_ns;
+    }
+    return 0;
+}
+
+static int bench_key(void) {
+    struct samples read_lat = { 0 }, event_lat = { 0 }, frame_lat = { 0 };
+    char path[512], echo[8] = "N";
+    int pull_fd, dev_fd;
+    uint64_t t0, t_ev, t_read, t_frame;
+    FILE *f;
+
+    if (!config.sim_dir) {
+        fprintf(stderr, "key: skipped, needs -s gpiochip_dir\n");
+        return 0;
+    }
+    f = fopen("/sys/module/tm1628/parameters/key_echo", "r");
+    if (f) {
+        if (!fgets(echo, sizeof(echo), f))
+            echo[0] = 'N';
+        fclose(f);
+    }
+    snprintf(path, sizeof(path), "%s/sim_gpio%u/pull", config.sim_dir, config.dio_offset);
+    pull_fd = open(path, O_WRONLY);
+    if (pull_fd < 0) {
+        perror(path);
+        return -1;
+    }
+    dev_fd = open(config.chardev, O_RDONLY | O_NONBLOCK);
+    if (dev_fd < 0) {
+        perror(config.chardev);
+        close(pull_fd);
+        return -1;
+    }
+    sim_pull(pull_fd, 0);
+    sleep_us(500000);
+    while (read(dev_fd, path, sizeof(path)) > 0)
+        ;
+
+    fprintf(stderr, "key: %d presses\n", config.presses);
+    for (int i = 0; i < config.presses; i++) {
+        long frames = frames_read();
+
+        t0 = now_ns(CLOCK_MONOTONIC);
+        if (sim_pull(pull_fd, 1) < 0)
+            break;
+        t_ev = key_event_wait(dev_fd, 1);
+        t_read = now_ns(CLOCK_MONOTONIC);
+        t_frame = echo[0] == 'Y' ? frames_wait(frames, CLOCK_MONOTONIC, 1000) : 0;
+        if (t_ev) {
+            samples_add(&event_lat, (t_ev - t0) / 1e3);
+            samples_add(&read_lat, (t_read - t0) / 1e3);
+        }
+        if (t_frame)
+            samples_add(&frame_lat, (t_frame - t0) / 1e3);
+
+        sim_pull(pull_fd, 0);
+        key_event_wait(dev_fd, 0);
+        // Land the next press at a different point of the scan interval
+        sleep_us(50000 + rand() % 100000);
+    }
+    close(dev_fd);
+    close(pull_fd);
+
+    printf("  \"key_latency_us\": {\n");
+    print_stats("scan", &event_lat, 0);
+    print_stats("read", &read_lat, 0);
+    print_stats("echo_frame", &frame_lat, 1);
+    printf("  },\n");
+    return 0;
+}
+
+// --- Main ---
+
+static int parse_args(int argc, char *argv[]) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "D:c:t:n:T:s:o:r:p:")) != -1) {
+        switch (opt) {
+        case 'D':
+            config.dir = optarg;
+            break;
+        case 'c':
+            config.chardev = optarg;
+            break;
+        case 't':
+            config.tests = optarg;
+            break;
+        case 'n':
+            config.writes = atoi(optarg);
+            break;
+        case 'T':
+            config.time_secs = atoi(optarg);
+            break;
+        case 's':
+            config.sim_dir = optarg;
+            break;
+        case 'o':
+            config.dio_offset = atoi(optarg);
+            break;
+        case 'r':
+            config.presses = atoi(optarg);
+            break;
+        case 'p':
+            config.poll_us = atoi(optarg);
+            break;
+        default:
+            return -1;
+        }
+    }
+    return config.writes > 0 && config.poll_us > 0 ? 0 : -1;
+}
+
+static int want(const char *test) {
+    size_t len = strlen(test);
+
+    for (const char *p = config.tests; (p = strstr(p, test)); p += len)
+        if ((p == config.tests || p[-1] == ',') && (p[len] == ',' || !p[len]))
+            return 1;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    static char chardev[256];
+    char label[64] = "", old_display[64] = "", dir[512];
+    int ret = 0;
+
+    if (parse_args(argc, argv) < 0) {
+        fprintf(stderr, "Usage: %s [-D sysfs_dir] [-c chardev] [-t fps,sysfs,time,key] "
+                "[-n writes] [-T secs] [-s gpiochip_dir] [-o dio_offset] [-r presses] "
+                "[-p poll_us]\n", argv[0]);
+        return 1;
+    }
+    if (!config.chardev) {
+        snprintf(dir, sizeof(dir), "%s", config.dir);
+        snprintf(chardev, sizeof(chardev), "/dev/%s", basename(dir));
+        config.chardev = chardev;
+    }
+
+    frames_fd = attr_open("frames", O_RDONLY);
+    if (frames_fd < 0)
+        return 1;
+    attr_read("label", label, sizeof(label));
+    attr_read("display", old_display, sizeof(old_display));
+    srand(time(NULL));
+
+    printf("{\n  \"device\": \"%s\", \"label\": \"%s\", \"timestamp\": %lld,\n",
+           config.dir, label, (long long)time(NULL));
+    if (want("fps") && bench_fps() < 0)
+        ret = 1;
+    if (want("sysfs") && bench_sysfs() < 0)
+        ret = 1;
+    if (want("time") && bench_time() < 0)
+        ret = 1;
+    if (want("key") && bench_key() < 0)
+        ret = 1;
+    printf("  \"ok\": %s\n}\n", ret ? "false" : "true");
+
+    if (old_display[0])
+        attr_write("display", old_display);
+    close(frames_fd);
+    return ret;
+}
@@ -0,0 +1,799 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+// TM1628 protocol emulator and waveform decoder.
+//
+// Replays the STB/DIO/CLK lines of a TM1628 bus through a model of the
+// chip: command, data, address and display control decoding, auto and fixed
+// addressing, the 14-byte display RAM and a scripted key matrix answering
+// the 0x42 key read. Every strobe frame is decoded and checked against the
+// datasheet, and the write frames of one display update are summed into
+// edge counts and bus time, so driver throughput changes can be compared
+// without a board or a scope.
+//
+// Build:
+//   gcc -O2 -o tm1628_emu tm1628_emu.c
+//
+// Usage: tm1628_emu (-v trace.vcd | -s gpiochip_dir) [-n stb,dio,clk] [-o stb,dio,clk]
+//                   [-k b0,b1,b2,b3,b4] [-K keyscript] [-g gap_us] [-t secs] [-T] [-q] [-r]
+//   -v  decode a captured edge trace in VCD format ("-" = stdin), e.g. from
+//       sigrok-cli -O vcd or a simulator
+//   -n  VCD signal names for STB, DIO and CLK (default stb,dio,clk)
+//   -s  follow a gpio-sim chip, e.g. /sys/devices/platform/gpio-sim.0/gpiochip2,
+//       by polling its sim_gpioN/value files; the key read is answered through
+//       sim_gpioN/pull. Polling is slow, so give the driver's DT node
+//       clock-frequency = <1000> when reading keys this way.
+//   -o  gpio-sim: line offsets of STB, DIO and CLK (default 18,19,21)
+//   -t  gpio-sim: stop after this many seconds (default: run until Ctrl-C)
+//   -k  key matrix bytes returned by every key read, hex (default all 0)
+//   -K  key script, lines of "<ms> b0 b1 b2 b3 b4" in hex: from <ms> after
+//       the first edge on, key reads return those bytes
+//   -g  idle time that ends a display update, in microseconds (default 50)
+//   -T  skip the datasheet timing checks (always off for gpio-sim)
+//   -q  print only the summary
+//   -r  print the display RAM after every update
+
+// Bus lines, in the same order as the -n and -o arguments
+enum { LINE_STB, LINE_DIO, LINE_CLK, NUM_LINES };
+
+// Datasheet limits in ns
+#define MIN_PW_CLK_NS   400     // CLK high and low width
+#define MIN_PW_STB_NS   1000    // STB high width, last CLK to STB rising
+#define MIN_WAIT_NS     1000    // key read command to first CLK falling edge
+#define MIN_SETUP_NS    100     // DIO stable before CLK rising
+#define MIN_HOLD_NS     100     // DIO stable after CLK rising
+
+#define RAM_BYTES       14
+#define KEY_BYTES       5
+#define FRAME_BYTES     32      // bytes of a strobe frame kept for printing
+
+#define MAX_KEY_STEPS   256
+
+struct key_step {
+    uint64_t t_ns;
+    unsigned char keys[KEY_BYTES];
+};
+
+// Command line configuration
+struct emu_config {
+    const char *vcd;
+    const char *names[NUM_LINES];
+    const char *sim_dir;
+    unsigned int offsets[NUM_LINES];
+    double duration;
+    unsigned int gap_ns;
+    int timing;
+    int quiet;
+    int show_ram;
+};
+
+static struct emu_config config = {
+    .names = { "stb", "dio", "clk" },
+    .offsets = { 18, 19, 21 },
+    .gap_ns = 50000,
+    .timing = 1,
+};
+
+static struct key_step key_steps[MAX_KEY_STEPS] = { { 0, { 0 } } };
+static int num_key_steps = 1;
+
+// Chip and decoder state
+struct emu {
+    // Line levels and when they last changed
+    int level[NUM_LINES];
+    uint64_t changed[NUM_LINES];
+    uint64_t t0;
+    int started;
+
+    // Chip state, kept across strobe frames
+    unsigned char ram[RAM_BYTES];
+    int mode;                   // display mode command 0-3
+    int display_on;
+    int pulse;                  // pulse width setting 0-7
+    int read_mode;              // last data command was a key read
+    int fixed;                  // last data command selected fixed addressing
+
+    // Current strobe frame
+    int in_frame;
+    uint64_t frame_start;
+    uint64_t last_stb_rise;
+    uint64_t cmd_end;           // CLK rising edge that ended the command byte
+    unsigned int edges;
+    int bits;
+    unsigned int shift;
+    int nbytes;
+    unsigned char bytes[FRAME_BYTES];
+    int addr;                   // -1 until an address command
+    int reading;                // clocking out key bytes
+    unsigned char key_out[KEY_BYTES];
+    int dio_out;                // level the chip drives on DIO while reading
+    const char *reported[8];    // violations already printed for this frame
+    int num_reported;
+
+    // Current display update: write frames separated by less than gap_ns
+    int in_update;
+    uint64_t update_start, update_end;
+    unsigned int update_edges, update_frames, update_bytes;
+
+    // Totals
+    unsigned long frames, updates, key_reads, violations;
+    unsigned long edges_total, update_edges_total;
+    uint64_t bus_ns_total, update_ns_total;
+};
+
+static struct emu emu = {
+    .level = { 1, 1, 1 },
+    .mode = 2,
+    .dio_out = 1,
+    .last_stb_rise = 0,
+};
+
+static const char *mode_names[4] = { "4x13", "5x12", "6x11", "7x10" };
+
+// Display control pulse width settings, in 1/16ths
+static const int pulse_widths[8] = { 1, 2, 4, 10, 11, 12, 13, 14 };
+
+static double ts(const struct emu *e, uint64_t t) {
+    return (t - e->t0) / 1e9;
+}
+
+// Report a protocol or timing violation at time t
+static void violation(struct emu *e, uint64_t t, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void violation(struct emu *e, uint64_t t, const char *fmt, ...) {
+    va_list ap;
+
+    e->violations++;
+    if (config.quiet)
+        return;
+    // Print each kind once per frame, a slow clock would repeat on every bit
+    for (int i = 0; i < e->num_reported; i++)
+        if (e->reported[i] == fmt)
+            return;
+    if (e->num_reported < 8)
+        e->reported[e->num_reported++] = fmt;
+    printf("%12.6f  !! ", ts(e, t));
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+}
+
+// Key bytes the script holds at time t
+static const unsigned char *keys_at(const struct emu *e, uint64_t t) {
+    int i = 0;
+
+    while (i + 1 < num_key_steps && key_steps[i + 1].t_ns <= t - e->t0)
+        i++;
+    return key_steps[i].keys;
+}
+
+// Decode a 7-segment glyph back to a character for the RAM printout
+static char glyph_char(unsigned char seg) {
+    static const unsigned char digits[10] = {
+        0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F
+    };
+
+    seg &= 0x7F;
+    for (int d = 0; d < 10; d++)
+        if (digits[d] == seg)
+            return '0' + d;
+    switch (seg) {
+    case 0x00: return ' ';
+    case 0x40: return '-';
+    case 0x77: return 'A';
+    case 0x79: return 'E';
+    case 0x71: return 'F';
+    case 0x76: return 'H';
+    case 0x38: return 'L';
+    case 0x73: return 'P';
+    default:   return '?';
+    }
+}
+
+static void print_ram(const struct emu *e) {
+    int grids = 4 + e->mode;
+
+    printf("              RAM");
+    for (int i = 0; i < RAM_BYTES; i++)
+        printf(" %02x", e->ram[i]);
+    printf("  [");
+    for (int g = 0; g < grids; g++) {
+        printf("%c", glyph_char(e->ram[2 * g]));
+        if (e->ram[2 * g] & 0x80)
+            printf(".");
+    }
+    printf("] %s %s\n", e->display_on ? "on" : "off", mode_names[e->mode]);
+}
+
+static void end_update(struct emu *e) {
+    uint64_t span;
+
+    if (!e->in_update)
+        return;
+    e->in_update = 0;
+    span = e->update_end - e->update_start;
+    e->updates++;
+    e->update_edges_total += e->update_edges;
+    e->update_ns_total += span;
+    if (config.quiet)
+        return;
+    printf("%12.6f  update %lu: %u frames, %u bytes, %u edges, %.1f us\n",
+           ts(e, e->update_start), e->updates, e->update_frames,
+           e->update_bytes, e->update_edges, span / 1e3);
+    if (config.show_ram)
+        print_ram(e);
+}
+
+// Handle a completed byte written by the host
+static void write_byte(struct emu *e, uint64_t t, unsigned char b) {
+    int n = e->nbytes++;
+
+    if (n < FRAME_BYTES)
+        e->bytes[n] = b;
+
+    if (n > 0) {
+        if (e->addr < 0) {
+            violation(e, t, "data byte 0x%02x after command 0x%02x", b, e->bytes[0]);
+            return;
+        }
+        if (e->read_mode)
+            violation(e, t, "display data written while in key read mode");
+        if (e->fixed && n > 1)
+            violation(e, t, "more than one data byte in fixed address mode");
+        if (e->addr >= RAM_BYTES) {
+            violation(e, t, "display RAM address 0x%02x out of range", e->addr);
+            return;
+        }
+        e->ram[e->addr] = b;
+        if (!e->fixed)
+            e->addr++;
+        return;
+    }
+
+    // First byte of the frame: the command
+    switch (b & 0xC0) {
+    case 0x00:
+        if (b & 0x3C)
+            violation(e, t, "reserved bits set in display mode command 0x%02x", b);
+        e->mode = b & 0x03;
+        break;
+    case 0x40:
+        if ((b & 0x03) == 0x01 || (b & 0x03) == 0x03)
+            violation(e, t, "unknown data command 0x%02x", b);
+        e->read_mode = (b & 0x03) == 0x02;
+        e->fixed = !!(b & 0x04);
+        if (e->read_mode) {
+            memcpy(e->key_out, keys_at(e, t), KEY_BYTES);
+            e->reading = 1;
+            e->cmd_end = t;
+            e->key_reads++;
+        }
+        break;
+    case 0x80:
+        e->display_on = !!(b & 0x08);
+        e->pulse = b & 0x07;
+        break;
+    case 0xC0:
+        e->addr = b & 0x0F;
+        break;
+    }
+}
+
+static void describe_frame(const struct emu *e, char *buf, size_t len) {
+    unsigned char cmd = e->bytes[0];
+    int shown = e->nbytes < FRAME_BYTES ? e->nbytes : FRAME_BYTES;
+    size_t pos = 0;
+
+    if (!e->nbytes) {
+        snprintf(buf, len, "empty frame");
+        return;
+    }
+    switch (cmd & 0xC0) {
+    case 0x00:
+        pos = snprintf(buf, len, "MODE %s", mode_names[cmd & 0x03]);
+        break;
+    case 0x40:
+        if ((cmd & 0x03) == 0x02)
+            pos = snprintf(buf, len, "READ keys");
+        else
+            pos = snprintf(buf, len, "DATA write %s", cmd & 0x04 ? "fixed" : "auto");
+        break;
+    case 0x80:
+        pos = snprintf(buf, len, "CTRL %s pulse %d/16", cmd & 0x08 ? "on" : "off",
+                       pulse_widths[cmd & 0x07]);
+        break;
+    case 0xC0:
+        pos = snprintf(buf, len, "ADDR 0x%02x", cmd & 0x0F);
+        break;
+    }
+    if ((cmd & 0xC3) == 0x42) {
+        // Bytes clocked out of the key matrix, not host writes
+        for (int i = 0; i < e->nbytes - 1 && i < KEY_BYTES && pos < len; i++)
+            pos += snprintf(buf + pos, len - pos, " %02x", e->key_out[i]);
+        return;
+    }
+    for (int i = 1; i < shown && pos < len; i++)
+        pos += snprintf(buf + pos, len - pos, " %02x", e->bytes[i]);
+    if (shown < e->nbytes && pos < len)
+        snprintf(buf + pos, len - pos, " ...");
+}
+
+static void start_frame(struct emu *e, uint64_t t) {
+    if (config.timing && e->last_stb_rise && t - e->last_stb_rise < MIN_PW_STB_NS)
+        violation(e, t, "STB high for %llu ns, need %d",
+                  (unsigned long long)(t - e->last_stb_rise), MIN_PW_STB_NS);
+    if (e->in_update && t - e->update_end > config.gap_ns)
+        end_update(e);
+    e->in_frame = 1;
+    e->frame_start = t;
+    e->edges = 1;
+    e->bits = 0;
+    e->shift = 0;
+    e->nbytes = 0;
+    e->addr = -1;
+    e->reading = 0;
+    e->num_reported = 0;
+}
+
+static void end_frame(struct emu *e, uint64_t t) {
+    uint64_t span = t - e->frame_start;
+    char desc[256];
+    int is_read = e->nbytes && (e->bytes[0] & 0xC3) == 0x42;
+
+    if (e->bits)
+        violation(e, t, "STB rose after %d bits of a byte", e->bits);
+    if (config.timing && e->nbytes && t - e->changed[LINE_CLK] < MIN_PW_STB_NS)
+        violation(e, t, "last CLK edge to STB rising %llu ns, need %d",
+                  (unsigned long long)(t - e->changed[LINE_CLK]), MIN_PW_STB_NS);
+    e->in_frame = 0;
+    e->reading = 0;
+    e->dio_out = 1;
+    e->last_stb_rise = t;
+    e->frames++;
+    e->edges_total += e->edges;
+    e->bus_ns_total += span;
+
+    if (is_read) {
+        end_update(e);
+    } else {
+        if (!e->in_update) {
+            e->in_update = 1;
+            e->update_start = e->frame_start;
+            e->update_edges = 0;
+            e->update_frames = 0;
+            e->update_bytes = 0;
+        }
+        e->update_end = t;
+        e->update_edges += e->edges;
+        e->update_frames++;
+        e->update_bytes += e->nbytes;
+    }
+
+    if (config.quiet)
+        return;
+    describe_frame(e, desc, sizeof(desc));
+    printf("%12.6f  %-48s %4u edges %8.2f us\n", ts(e, e->frame_start), desc,
+           e->edges, span / 1e3);
+}
+
+// CLK rising edge inside a frame
+static void clk_rise(struct emu *e, uint64_t t) {
+    if (config.timing && t - e->changed[LINE_CLK] < MIN_PW_CLK_NS)
+        violation(e, t, "CLK low for %llu ns, need %d",
+                  (unsigned long long)(t - e->changed[LINE_CLK]), MIN_PW_CLK_NS);
+
+    if (e->reading) {
+        // The host samples the chip's output; keep count of whole bytes
+        if (++e->bits == 8) {
+            e->bits = 0;
+            if (++e->nbytes - 1 > KEY_BYTES)
+                violation(e, t, "more than %d key bytes read", KEY_BYTES);
+        }
+        return;
+    }
+
+    if (config.timing && t - e->changed[LINE_DIO] < MIN_SETUP_NS)
+        violation(e, t, "DIO set-up %llu ns before CLK rising, need %d",
+                  (unsigned long long)(t - e->changed[LINE_DIO]), MIN_SETUP_NS);
+    e->shift |= (unsigned int)e->level[LINE_DIO] << e->bits;
+    if (++e->bits == 8) {
+        unsigned char b = e->shift;
+
+        e->bits = 0;
+        e->shift = 0;
+        write_byte(e, t, b);
+    }
+}
+
+// CLK falling edge inside a frame: the chip shifts out the next key bit
+static void clk_fall(struct emu *e, uint64_t t) {
+    int byte;
+
+    if (config.timing && t - e->changed[LINE_CLK] < MIN_PW_CLK_NS)
+        violation(e, t, "CLK high for %llu ns, need %d",
+                  (unsigned long long)(t - e->changed[LINE_CLK]), MIN_PW_CLK_NS);
+    if (!e->reading)
+        return;
+    if (config.timing && e->nbytes == 1 && e->bits == 0 && t - e->cmd_end < MIN_WAIT_NS)
+        violation(e, t, "key read started %llu ns after the command, need %d",
+                  (unsigned long long)(t - e->cmd_end), MIN_WAIT_NS);
+    byte = e->nbytes - 1;
+    e->dio_out = byte < KEY_BYTES ? (e->key_out[byte] >> e->bits) & 1 : 0;
+}
+
+// Feed the line levels after all changes at time t
+static void emu_update(struct emu *e, uint64_t t, const int level[NUM_LINES]) {
+    int changed[NUM_LINES];
+
+    if (!e->started) {
+        e->started = 1;
+        e->t0 = t;
+        memcpy(e->level, level, sizeof(e->level));
+        for (int l = 0; l < NUM_LINES; l++)
+            e->changed[l] = t;
+        return;
+    }
+
+    for (int l = 0; l < NUM_LINES; l++) {
+        changed[l] = level[l] != e->level[l];
+        if (changed[l] && e->in_frame)
+            e->edges++;
+    }
+
+    // STB falling, then DIO, then CLK, then STB rising
+    if (changed[LINE_STB] && !level[LINE_STB])
+        start_frame(e, t);
+
+    if (changed[LINE_DIO]) {
+        if (config.timing && e->in_frame && !e->reading && e->level[LINE_CLK] &&
+            !changed[LINE_CLK] && t - e->changed[LINE_CLK] < MIN_HOLD_NS)
+            violation(e, t, "DIO changed %llu ns after CLK rising, need %d",
+                      (unsigned long long)(t - e->changed[LINE_CLK]), MIN_HOLD_NS);
+        e->level[LINE_DIO] = level[LINE_DIO];
+        e->changed[LINE_DIO] = t;
+    }
+
+    if (changed[LINE_CLK]) {
+        if (e->in_frame) {
+            if (level[LINE_CLK])
+                clk_rise(e, t);
+            else
+                clk_fall(e, t);
+        }
+        e->level[LINE_CLK] = level[LINE_CLK];
+        e->changed[LINE_CLK] = t;
+    }
+
+    if (changed[LINE_STB]) {
+        if (level[LINE_STB] && e->in_frame)
+            end_frame(e, t);
+        e->level[LINE_STB] = level[LINE_STB];
+        e->changed[LINE_STB] = t;
+    }
+}
+
+static void print_summary(struct emu *e) {
+    end_update(e);
+    printf("\nframes %lu (%lu key reads), updates %lu, violations %lu\n",
+           e->frames, e->key_reads, e->updates, e->violations);
+    printf("bus: %lu edges, %.1f us in frames\n", e->edges_total, e->bus_ns_total / 1e3);
+    if (e->updates)
+        printf("updates: %.1f edges, %.2f us each on average\n",
+               (double)e->update_edges_total / e->updates,
+               e->update_ns_total / 1e3 / e->updates);
+    print_ram(e);
+}
+
+// --- VCD input ---
+
+// Read one whitespace separated token; returns 0 at end of file
+static int vcd_token(FILE *f, char *tok, size_t len) {
+    int c;
+    size_t n = 0;
+
+    do {
+        c = fgetc(f);
+    } while (c != EOF && isspace(c));
+    while (c != EOF && !isspace(c)) {
+        if (n + 1 < len)
+            tok[n++] = c;
+        c = fgetc(f);
+    }
+    tok[n] = '\0';
+    return n > 0;
+}
+
+// Timescale "1ns", "10 us", ... to nanoseconds per tick
+static double vcd_timescale(const char *spec) {
+    static const struct { const char *unit; double ns; } units[] = {
+        { "fs", 1e-6 }, { "ps", 1e-3 }, { "ns", 1 }, { "us", 1e3 }, { "ms", 1e6 }, { "s", 1e9 },
+    };
+    char *end;
+    double mult = strtod(spec, &end);
+
+    while (isspace((unsigned char)*end))
+        end++;
+    for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++)
+        if (!strcmp(end, units[i].unit))
+            return mult * units[i].ns;
+    return -1;
+}
+
+static int run_vcd(const char *path) {
+    FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    char tok[256], ids[NUM_LINES][64] = { { 0 } }, spec[64] = "";
+    int level[NUM_LINES] = { 1, 1, 1 };
+    double scale = 1;
+    uint64_t now = 0;
+    int have_time = 0, found = 0;
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    // Header: timescale and the identifier codes of our three signals
+    while (vcd_token(f, tok, sizeof(tok))) {
+        if (!strcmp(tok, "$timescale")) {
+            spec[0] = '\0';
+            while (vcd_token(f, tok, sizeof(tok)) && strcmp(tok, "$end"))
+                strncat(spec, tok, sizeof(spec) - strlen(spec) - 1);
+            scale = vcd_timescale(spec);
+            if (scale <= 0) {
+                fprintf(stderr, "Unsupported timescale '%s'\n", spec);
+                return -1;
+            }
+        } else if (!strcmp(tok, "$var")) {
+            char type[32], width[32], id[64], name[128];
+
+            if (!vcd_token(f, type, sizeof(type)) || !vcd_token(f, width, sizeof(width)) ||
+                !vcd_token(f, id, sizeof(id)) || !vcd_token(f, name, sizeof(name)))
+                break;
+            for (int l = 0; l < NUM_LINES; l++) {
+                if (!strcasecmp(name, config.names[l]) && !ids[l][0]) {
+                    snprintf(ids[l], sizeof(ids[l]), "%s", id);
+                    found++;
+                }
+            }
+            while (vcd_token(f, tok, sizeof(tok)) && strcmp(tok, "$end"))
+                ;
+        } else if (!strcmp(tok, "$enddefinitions")) {
+            vcd_token(f, tok, sizeof(tok));
+            break;
+        }
+    }
+    if (found != NUM_LINES) {
+        fprintf(stderr, "Signals %s,%s,%s not all found in %s\n",
+                config.names[0], config.names[1], config.names[2], path);
+        return -1;
+    }
+
+    // Value changes; the changes of one timestamp are applied together
+    while (vcd_token(f, tok, sizeof(tok))) {
+        if (tok[0] == '#') {
+            uint64_t t = (uint64_t)(strtoull(tok + 1, NULL, 10) * scale);
+
+            if (have_time)
+                emu_update(&emu, now, level);
+            now = t;
+            have_time = 1;
+        } else if (tok[0] == '0' || tok[0] == '1' || tok[0] == 'x' || tok[0] == 'X' ||
+                   tok[0] == 'z' || tok[0] == 'Z') {
+            for (int l = 0; l < NUM_LINES; l++)
+                if (!strcmp(tok + 1, ids[l]) && (tok[0] == '0' || tok[0] == '1'))
+                    level[l] = tok[0] == '1';
+        } else if (tok[0] == 'b' || tok[0] == 'B' || tok[0] == 'r' || tok[0] == 'R') {
+            vcd_token(f, tok, sizeof(tok));     // vector value, skip its identifier
+        }
+        // $dumpvars, $end, $comment contents and the like are ignored
+    }
+    if (have_time)
+        emu_update(&emu, now, level);
+    if (f != stdin)
+        fclose(f);
+    return 0;
+}
+
+// --- gpio-sim input ---
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static int sim_open(const char *attr, unsigned int offset, int flags) {
+    char path[512];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/sim_gpio%u/%s", config.sim_dir, offset, attr);
+    fd = open(path, flags);
+    if (fd < 0)
+        perror(path);
+    return fd;
+}
+
+static int sim_read(int fd) {
+    char c;
+
+    if (pread(fd, &c, 1, 0) != 1)
+        return -1;
+    return c == '1';
+}
+
+static int run_sim(void) {
+    int value_fd[NUM_LINES], pull_fd, level[NUM_LINES], last[NUM_LINES] = { -1, -1, -1 };
+    int pull = -1;
+    struct timespec now, start;
+
+    for (int l = 0; l < NUM_LINES; l++) {
+        value_fd[l] = sim_open("value", config.offsets[l], O_RDONLY);
+        if (value_fd[l] < 0)
+            return -1;
+    }
+    pull_fd = sim_open("pull", config.offsets[LINE_DIO], O_WRONLY);
+    if (pull_fd < 0)
+        return -1;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (!stop) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (config.duration > 0 &&
+            (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9 > config.duration)
+            break;
+        for (int l = 0; l < NUM_LINES; l++)
+            level[l] = sim_read(value_fd[l]);
+        if (memcmp(level, last, sizeof(level))) {
+            emu_update(&emu, now.tv_sec * 1000000000ull + now.tv_nsec, level);
+            memcpy(last, level, sizeof(level));
+        }
+        // Drive the key bits back through the DIO pull while it is an input
+        if (emu.dio_out != pull) {
+            const char *v = emu.dio_out ? "pull-up" : "pull-down";
+
+            if (pwrite(pull_fd, v, strlen(v), 0) < 0)
+                perror("pull");
+            pull = emu.dio_out;
+        }
+    }
+
+    for (int l = 0; l < NUM_LINES; l++)
+        close(value_fd[l]);
+    close(pull_fd);
+    return 0;
+}
+
+// --- Arguments ---
+
+static int parse_keys(const char *arg, unsigned char keys[KEY_BYTES]) {
+    unsigned int v[KEY_BYTES];
+
+    if (sscanf(arg, "%x%*[, ]%x%*[, ]%x%*[, ]%x%*[, ]%x",
+               &v[0], &v[1], &v[2], &v[3], &v[4]) != KEY_BYTES)
+        return -1;
+    for (int i = 0; i < KEY_BYTES; i++)
+        keys[i] = v[i];
+    return 0;
+}
+
+static int load_key_script(const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[256];
+    double ms;
+    int n;
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) && num_key_steps < MAX_KEY_STEPS) {
+        char *p = line;
+
+        while (isspace((unsigned char)*p))
+            p++;
+        if (!*p || *p == '#')
+            continue;
+        if (sscanf(p, "%lf %n", &ms, &n) != 1 || parse_keys(p + n, key_steps[num_key_steps].keys) < 0) {
+            fprintf(stderr, "%s: bad line: %s", path, line);
+            fclose(f);
+            return -1;
+        }
+        key_steps[num_key_steps++].t_ns = ms * 1e6;
+    }
+    fclose(f);
+    return 0;
+}
+
+static int parse_args(int argc, char *argv[]) {
+    int opt;
+    char *names;
+
+    while ((opt = getopt(argc, argv, "v:n:s:o:t:k:K:g:Tqr")) != -1) {
+        switch (opt) {
+        case 'v':
+            config.vcd = optarg;
+            break;
+        case 'n':
+            names = strdup(optarg);
+            for (int l = 0; l < NUM_LINES; l++)
+                config.names[l] = strsep(&names, ",");
+            if (!config.names[NUM_LINES - 1])
+                return -1;
+            break;
+        case 's':
+            config.sim_dir = optarg;
+            break;
+        case 'o':
+            if (sscanf(optarg, "%u,%u,%u", &config.offsets[0], &config.offsets[1],
+                       &config.offsets[2]) != NUM_LINES)
+                return -1;
+            break;
+        case 't':
+            config.duration = atof(optarg);
+            break;
+        case 'k':
+            if (parse_keys(optarg, key_steps[0].keys) < 0)
+                return -1;
+            break;
+        case 'K':
+            if (load_key_script(optarg) < 0)
+                return -1;
+            break;
+        case 'g':
+            config.gap_ns = atoi(optarg) * 1000u;
+            break;
+        case 'T':
+            config.timing = 0;
+            break;
+        case 'q':
+            config.quiet = 1;
+            break;
+        case 'r':
+            config.show_ram = 1;
+            break;
+        default:
+            return -1;
+        }
+    }
+    return !config.vcd == !config.sim_dir ? -1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    int ret;
+
+    if (parse_args(argc, argv) < 0) {
+        fprintf(stderr, "Usage: %s (-v trace.vcd | -s gpiochip_dir) [-n stb,dio,clk] "
+                "[-o stb,dio,clk] [-k b0,b1,b2,b3,b4] [-K keyscript] [-g gap_us] "
+                "[-t secs] [-T] [-q] [-r]\n", argv[0]);
+        return 1;
+    }
+
+    if (config.vcd) {
+        ret = run_vcd(config.vcd);
+    } else {
+        // Polling timestamps say nothing about the real bus timing
+        config.timing = 0;
+        ret = run_sim();
+    }
+    if (ret < 0)
+        return 1;
+
+    print_summary(&emu);
+    return emu.violations ? 2 : 0;
+}
@@ -1,9 +1,46 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
 #include <time.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ctype.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#ifndef NO_LIBGPIOD
+#include <gpiod.h>
+#endif
+
+// Build:
+//   gcc -O2 -o tm1628 user_space_tm1628.c -lgpiod        (sysfs + gpiod)
+//   gcc -O2 -DNO_LIBGPIOD -o tm1628 user_space_tm1628.c  (sysfs only)
+//
+// Usage: tm1628 [-b sysfs|gpiod|mmio] [-c chip] [-o stb,dio,clk] [-n stb,dio,clk]
+//               [-g stb,dio,clk] [-m mmio.conf] [-d delay_us] [-B frames] [-k]
+//               [-D socket] [-r ticks]
+//   -b  bus backend (default gpiod when built with libgpiod)
+//   -c  gpiod: chip path or name, e.g. /dev/gpiochip2 or gpiochip2
+//   -o  gpiod: line offsets on the chip (default 18,19,21)
+//   -n  gpiod: line names, searched on -c or on every chip (e.g. gpio-sim)
+//   -g  sysfs: global GPIO numbers (default 530,531,533)
+//   -m  mmio: register layout file, see tm1628_mmio.conf
+//   -d  sysfs/gpiod: delay per bus phase in microseconds (default 5, 0 = none)
+//   -B  benchmark: push N frames through every backend and print fps
+//   -k  print the key scan bytes whenever they change
+//   -D  daemon: own the bus and take text, numbers and frames from clients
+//       on this Unix-domain socket, e.g. /run/tm1628.sock (see run_daemon)
+//   -r  daemon: ticks per second, aligned to whole seconds (default 10)
 
 // Paths for sysfs GPIO
 #define GPIO_EXPORT "/sys/class/gpio/export"
@@ -14,6 +51,58 @@
 #define GPIO_DIO  531  // GPIO2_IO19 = 512 + 19
 #define GPIO_CLK  533  // GPIO2_IO21 = 512 + 21
 
+// Bus lines, used as indices and as bit masks for multi-line writes
+enum { LINE_STB, LINE_DIO, LINE_CLK, NUM_LINES };
+#define LINE_BIT(l) (1u << (l))
+
+// Command line configuration
+struct tm1628_config {
+    const char *backend;
+    const char *chip;
+    unsigned int offsets[NUM_LINES];
+    const char *names[NUM_LINES];
+    int gpios[NUM_LINES];
+    const char *mmio_config;
+    int delay;
+    int bench_frames;
+    int keys;
+    const char *socket_path;
+    int rate;
+};
+
+static struct tm1628_config config = {
+    .offsets = { 18, 19, 21 },
+    .gpios = { GPIO_STB, GPIO_DIO, GPIO_CLK },
+    .delay = 5,
+    .rate = 10,
+};
+
+// A GPIO transport drives the three bus lines. set() changes every line in
+// mask to the matching bit of values, in as few operations as it can.
+struct gpio_transport {
+    const char *name;
+    int (*open)(const struct tm1628_config *cfg);
+    void (*set)(unsigned int mask, unsigned int values);
+    int (*get)(int line);
+    void (*direction)(int line, int output);
+    void (*close)(void);
+};
+
+// A bus backend implements the TM1628 wire primitives. The sysfs and gpiod
+// backends bit-bang through a gpio_transport; mmio writes the GPIO
+// controller's registers directly.
+struct tm1628_backend {
+    const char *name;
+    int (*open)(const struct tm1628_config *cfg);
+    void (*send_byte)(unsigned char data);
+    unsigned char (*read_byte)(void);
+    void (*strobe)(int level);
+    void (*dio_input)(int input);   // turn DIO around for key reads
+    void (*close)(void);
+};
+
+static const struct tm1628_backend *bus;
+
 // Helper function to write a string to a file
 int write_to_file(const char *path, const char *value) {
     int fd = open(path, O_WRONLY);
@@ -38,6 +127,13 @@ void gpio_export(int pin) {
     usleep(100000);
 }
 
+// Release a GPIO pin
+void gpio_unexport(int pin) {
+    char buffer[10];
+    snprintf(buffer, sizeof(buffer), "%d", pin);
+    write_to_file(GPIO_UNEXPORT, buffer);
+}
+
 // Set GPIO direction ("in" or "out")
 void gpio_set_direction(int pin, const char *direction) {
     char path[50];
@@ -54,31 +150,583 @@ void gpio_write(int pin, int value) {
     write_to_file(path, valStr);
 }
 
+// Read the value (0 or 1) of a GPIO
+int gpio_read(int pin) {
+    char path[50];
+    char valStr[2] = "0";
+    int fd;
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", pin);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Unable to open file");
+        return 0;
+    }
+    if (read(fd, valStr, 1) < 0)
+        perror("Error reading file");
+    close(fd);
+    return valStr[0] == '1';
+}
+
+// --- sysfs transport: one open()+write()+close() per line change ---
+
+static int sysfs_open(const struct tm1628_config *cfg) {
+    for (int l = 0; l < NUM_LINES; l++) {
+        gpio_export(cfg->gpios[l]);
+        gpio_set_direction(cfg->gpios[l], "out");
+    }
+    return 0;
+}
+
+static void sysfs_set(unsigned int mask, unsigned int values) {
+    for (int l = 0; l < NUM_LINES; l++) {
+        if (mask & LINE_BIT(l))
+            gpio_write(config.gpios[l], !!(values & LINE_BIT(l)));
+    }
+}
+
+static int sysfs_get(int line) {
+    return gpio_read(config.gpios[line]);
+}
+
+static void sysfs_direction(int line, int output) {
+    gpio_set_direction(config.gpios[line], output ? "out" : "in");
+}
+
+static void sysfs_close(void) {
+    for (int l = 0; l < NUM_LINES; l++)
+        gpio_unexport(config.gpios[l]);
+}
+
+static const struct gpio_transport sysfs_transport = {
+    .name = "sysfs",
+    .open = sysfs_open,
+    .set = sysfs_set,
+    .get = sysfs_get,
+    .direction = sysfs_direction,
+    .close = sysfs_close,
+};
+
+#ifndef NO_LIBGPIOD
+// --- gpiod transport: one persistent line request on the GPIO chardev ---
+
+static struct gpiod_chip *gpiod_chip;
+static struct gpiod_line_request *gpiod_request;
+static unsigned int gpiod_offsets[NUM_LINES];
+// Last driven level and direction of each line, for reconfiguration
+static unsigned int gpiod_values = LINE_BIT(LINE_STB) | LINE_BIT(LINE_DIO) | LINE_BIT(LINE_CLK);
+static unsigned int gpiod_outputs = LINE_BIT(LINE_STB) | LINE_BIT(LINE_DIO) | LINE_BIT(LINE_CLK);
+
+// Open a chip given as a path or as a bare name under /dev
+static struct gpiod_chip *gpiod_open_chip(const char *chip) {
+    char path[64];
+
+    if (chip[0] == '/')
+        return gpiod_chip_open(chip);
+    snprintf(path, sizeof(path), "/dev/%s", chip);
+    return gpiod_chip_open(path);
+}
+
+// Resolve all line names on one chip; returns 0 if every name was found
+static int gpiod_lookup_names(struct gpiod_chip *chip, const struct tm1628_config *cfg) {
+    for (int l = 0; l < NUM_LINES; l++) {
+        int offset = gpiod_chip_get_line_offset_from_name(chip, cfg->names[l]);
+        if (offset < 0)
+            return -1;
+        gpiod_offsets[l] = offset;
+    }
+    return 0;
+}
+
+// Find the chip carrying the named lines, trying every /dev/gpiochip*
+static struct gpiod_chip *gpiod_find_chip(const struct tm1628_config *cfg) {
+    struct gpiod_chip *chip = NULL;
+    struct dirent *entry;
+    DIR *dir = opendir("/dev");
+
+    if (!dir)
+        return NULL;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "gpiochip", 8) != 0)
+            continue;
+        chip = gpiod_open_chip(entry->d_name);
+        if (chip && gpiod_lookup_names(chip, cfg) == 0)
+            break;
+        if (chip)
+            gpiod_chip_close(chip);
+        chip = NULL;
+    }
+    closedir(dir);
+    return chip;
+}
+
+static int gpiod_open(const struct tm1628_config *cfg) {
+    struct gpiod_line_settings *settings;
+    struct gpiod_line_config *line_cfg;
+    struct gpiod_request_config *req_cfg;
+
+    if (cfg->names[0]) {
+        if (cfg->chip) {
+            gpiod_chip = gpiod_open_chip(cfg->chip);
+            if (gpiod_chip && gpiod_lookup_names(gpiod_chip, cfg) < 0) {
+                fprintf(stderr, "Line names not found on %s\n", cfg->chip);
+                gpiod_chip_close(gpiod_chip);
+                gpiod_chip = NULL;
+                return -1;
+            }
+        } else {
+            gpiod_chip = gpiod_find_chip(cfg);
+        }
+    } else {
+        gpiod_chip = gpiod_open_chip(cfg->chip ? cfg->chip : "gpiochip2");
+        memcpy(gpiod_offsets, cfg->offsets, sizeof(gpiod_offsets));
+    }
+    if (!gpiod_chip) {
+        perror("Unable to open GPIO chip");
+        return -1;
+    }
+
+    // All three lines are outputs idling high
+    settings = gpiod_line_settings_new();
+    line_cfg = gpiod_line_config_new();
+    req_cfg = gpiod_request_config_new();
+    if (!settings || !line_cfg || !req_cfg)
+        goto out;
+    gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_OUTPUT);
+    gpiod_line_settings_set_output_value(settings, GPIOD_LINE_VALUE_ACTIVE);
+    gpiod_line_config_add_line_settings(line_cfg, gpiod_offsets, NUM_LINES, settings);
+    gpiod_request_config_set_consumer(req_cfg, "tm1628");
+    gpiod_request = gpiod_chip_request_lines(gpiod_chip, req_cfg, line_cfg);
+out:
+    gpiod_request_config_free(req_cfg);
+    gpiod_line_config_free(line_cfg);
+    gpiod_line_settings_free(settings);
+    if (!gpiod_request) {
+        perror("Unable to request GPIO lines");
+        gpiod_chip_close(gpiod_chip);
+        gpiod_chip = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// One ioctl for every line in mask
+static void gpiod_set(unsigned int mask, unsigned int values) {
+    unsigned int offsets[NUM_LINES];
+    enum gpiod_line_value vals[NUM_LINES];
+    size_t n = 0;
+
+    for (int l = 0; l < NUM_LINES; l++) {
+        if (!(mask & LINE_BIT(l)))
+            continue;
+        offsets[n] = gpiod_offsets[l];
+        vals[n] = (values & LINE_BIT(l)) ? GPIOD_LINE_VALUE_ACTIVE
+                                         : GPIOD_LINE_VALUE_INACTIVE;
+        n++;
+    }
+    if (gpiod_line_request_set_values_subset(gpiod_request, n, offsets, vals) < 0)
+        perror("Error setting GPIO lines");
+    gpiod_values = (gpiod_values & ~mask) | (values & mask);
+}
+
+static int gpiod_get(int line) {
+    return gpiod_line_request_get_value(gpiod_request, gpiod_offsets[line]) ==
+           GPIOD_LINE_VALUE_ACTIVE;
+}
+
+// Reconfigure the request with one line's direction changed; outputs keep
+// their current level so STB stays low across a DIO turnaround
+static void gpiod_direction(int line, int output) {
+    struct gpiod_line_config *line_cfg = gpiod_line_config_new();
+
+    if (!line_cfg)
+        return;
+    gpiod_outputs = output ? gpiod_outputs | LINE_BIT(line)
+                           : gpiod_outputs & ~LINE_BIT(line);
+    for (int l = 0; l < NUM_LINES; l++) {
+        struct gpiod_line_settings *settings = gpiod_line_settings_new();
+
+        if (!settings)
+            break;
+        if (gpiod_outputs & LINE_BIT(l)) {
+            gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_OUTPUT);
+            gpiod_line_settings_set_output_value(settings,
+                    (gpiod_values & LINE_BIT(l)) ? GPIOD_LINE_VALUE_ACTIVE
+                                                 : GPIOD_LINE_VALUE_INACTIVE);
+        } else {
+            gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_INPUT);
+        }
+        gpiod_line_config_add_line_settings(line_cfg, &gpiod_offsets[l], 1, settings);
+        gpiod_line_settings_free(settings);
+    }
+    if (gpiod_line_request_reconfigure_lines(gpiod_request, line_cfg) < 0)
+        perror("Error reconfiguring GPIO lines");
+    gpiod_line_config_free(line_cfg);
+}
+
+static void gpiod_close(void) {
+    gpiod_line_request_release(gpiod_request);
+    gpiod_chip_close(gpiod_chip);
+    gpiod_request = NULL;
+    gpiod_chip = NULL;
+}
+
+static const struct gpio_transport gpiod_transport = {
+    .name = "gpiod",
+    .open = gpiod_open,
+    .set = gpiod_set,
+    .get = gpiod_get,
+    .direction = gpiod_direction,
+    .close = gpiod_close,
+};
+#endif
+
 // Simple delay function in microseconds
 void delay_us(int us) {
-    usleep(us);
+    if (us > 0)
+        usleep(us);
 }
 
-// Send one byte to TM1628 via bit-banging (LSB first)
-void tm1628_send_byte(unsigned char data) {
+// Busy-wait for sub-microsecond delays that usleep() cannot give
+static void spin_ns(long ns) {
+    struct timespec start, now;
+
+    if (ns <= 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000000L +
+             (now.tv_nsec - start.tv_nsec) < ns);
+}
+
+// --- bit-bang backends on top of a GPIO transport ---
+
+static const struct gpio_transport *lines;
+
+// Send one byte via bit-banging (LSB first). CLK falls and the data bit is
+// presented in the same transport call.
+static void bitbang_send_byte(unsigned char data) {
+    for (int i = 0; i < 8; i++) {
+        lines->set(LINE_BIT(LINE_CLK) | LINE_BIT(LINE_DIO),
+                   ((data >> i) & 0x01) ? LINE_BIT(LINE_DIO) : 0);
+        delay_us(config.delay);
+        lines->set(LINE_BIT(LINE_CLK), LINE_BIT(LINE_CLK));
+        delay_us(config.delay);
+    }
+}
+
+// Read one byte (LSB first); the chip shifts a bit out on each falling CLK
+static unsigned char bitbang_read_byte(void) {
+    unsigned char byte = 0;
+
+    for (int i = 0; i < 8; i++) {
+        lines->set(LINE_BIT(LINE_CLK), 0);
+        delay_us(config.delay);
+        lines->set(LINE_BIT(LINE_CLK), LINE_BIT(LINE_CLK));
+        byte |= (lines->get(LINE_DIO) & 0x01) << i;
+        delay_us(config.delay);
+    }
+    return byte;
+}
+
+// Drive STB (active low frame select)
+static void bitbang_strobe(int value) {
+    lines->set(LINE_BIT(LINE_STB), value ? LINE_BIT(LINE_STB) : 0);
+    delay_us(config.delay);
+}
+
+static void bitbang_dio_input(int input) {
+    lines->direction(LINE_DIO, !input);
+    delay_us(config.delay);
+}
+
+static int bitbang_open_sysfs(const struct tm1628_config *cfg) {
+    lines = &sysfs_transport;
+    return lines->open(cfg);
+}
+
+static void bitbang_close(void) {
+    lines->close();
+}
+
+static const struct tm1628_backend sysfs_backend = {
+    .name = "sysfs",
+    .open = bitbang_open_sysfs,
+    .send_byte = bitbang_send_byte,
+    .read_byte = bitbang_read_byte,
+    .strobe = bitbang_strobe,
+    .dio_input = bitbang_dio_input,
+    .close = bitbang_close,
+};
+
+#ifndef NO_LIBGPIOD
+static int bitbang_open_gpiod(const struct tm1628_config *cfg) {
+    lines = &gpiod_transport;
+    return lines->open(cfg);
+}
+
+static const struct tm1628_backend gpiod_backend = {
+    .name = "gpiod",
+    .open = bitbang_open_gpiod,
+    .send_byte = bitbang_send_byte,
+    .read_byte = bitbang_read_byte,
+    .strobe = bitbang_strobe,
+    .dio_input = bitbang_dio_input,
+    .close = bitbang_close,
+};
+#endif
+
+// --- mmio backend: GPIO registers written through an mmap'd window ---
+//
+// The register layout comes from a "key = value" file (-m), see
+// tm1628_mmio.conf. Pointing "device" at a plain file instead of /dev/mem,
+// with "stand_in = 1", gives a stand-in that runs on any Linux box; leave
+// out set/clear there so the data register always holds the current line
+// levels.
+
+struct mmio_layout {
+    char device[256];
+    unsigned long base;
+    long data, set, clear, input, dir;   // register offsets, -1 = absent
+    int dir_out;                         // direction bit value for output
+    int stand_in;                        // device is a plain file we may create
+    int bits[NUM_LINES];                 // bit of each line in the bank
+    long half_period_ns;                 // minimum CLK half period
+};
+
+static struct mmio_layout mmio = {
+    .data = -1, .set = -1, .clear = -1, .input = -1, .dir = -1,
+    .dir_out = 1,
+    .bits = { -1, -1, -1 },
+    .half_period_ns = 500,
+};
+static void *mmio_map;
+static size_t mmio_map_len;
+static volatile uint32_t *mmio_regs;
+
+static int mmio_parse(const char *path) {
+    char line[300], key[32], value[256];
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        perror("Unable to open mmio config");
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long v;
+
+        if (sscanf(line, " %31[a-z_] = %255s", key, value) != 2 || key[0] == '#')
+            continue;
+        if (strcmp(key, "device") == 0) {
+            snprintf(mmio.device, sizeof(mmio.device), "%s", value);
+            continue;
+        }
+        v = strtoul(value, NULL, 0);
+        if (strcmp(key, "base") == 0)               mmio.base = v;
+        else if (strcmp(key, "data") == 0)          mmio.data = v;
+        else if (strcmp(key, "set") == 0)           mmio.set = v;
+        else if (strcmp(key, "clear") == 0)         mmio.clear = v;
+        else if (strcmp(key, "input") == 0)         mmio.input = v;
+        else if (strcmp(key, "dir") == 0)           mmio.dir = v;
+        else if (strcmp(key, "dir_out") == 0)       mmio.dir_out = !!v;
+        else if (strcmp(key, "stand_in") == 0)      mmio.stand_in = !!v;
+        else if (strcmp(key, "stb") == 0)           mmio.bits[LINE_STB] = v;
+        else if (strcmp(key, "dio") == 0)           mmio.bits[LINE_DIO] = v;
+        else if (strcmp(key, "clk") == 0)           mmio.bits[LINE_CLK] = v;
+        else if (strcmp(key, "half_period_ns") == 0) mmio.half_period_ns = v;
+        else
+            fprintf(stderr, "%s: unknown key '%s'\n", path, key);
+    }
+    fclose(f);
+
+    if (!mmio.device[0] || mmio.data < 0 || mmio.input < 0 || mmio.dir < 0 ||
+        mmio.bits[LINE_STB] < 0 || mmio.bits[LINE_DIO] < 0 || mmio.bits[LINE_CLK] < 0) {
+        fprintf(stderr, "%s: device, data, input, dir, stb, dio and clk are required\n", path);
+        return -1;
+    }
+    if ((mmio.set < 0) != (mmio.clear < 0)) {
+        fprintf(stderr, "%s: set and clear must be given together\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static inline uint32_t mmio_read(long reg) {
+    return mmio_regs[reg / 4];
+}
+
+static inline void mmio_write(long reg, uint32_t value) {
+    mmio_regs[reg / 4] = value;
+}
+
+// Bank bit mask for the lines selected in a LINE_BIT() mask
+static uint32_t mmio_bank_bits(unsigned int mask) {
+    uint32_t bits = 0;
+
+    for (int l = 0; l < NUM_LINES; l++) {
+        if (mask & LINE_BIT(l))
+            bits |= 1u << mmio.bits[l];
+    }
+    return bits;
+}
+
+static void mmio_set_lines(unsigned int mask, unsigned int values) {
+    uint32_t high = mmio_bank_bits(mask & values);
+    uint32_t low = mmio_bank_bits(mask & ~values);
+
+    if (mmio.set >= 0) {
+        if (high)
+            mmio_write(mmio.set, high);
+        if (low)
+            mmio_write(mmio.clear, low);
+    } else {
+        mmio_write(mmio.data, (mmio_read(mmio.data) & ~low) | high);
+    }
+}
+
+static int mmio_open(const struct tm1628_config *cfg) {
+    long page = sysconf(_SC_PAGESIZE);
+    unsigned long map_base;
+    long top;
+    struct stat st;
+    int fd;
+
+    if (!cfg->mmio_config) {
+        fprintf(stderr, "mmio backend needs -m <config>\n");
+        return -1;
+    }
+    if (mmio_parse(cfg->mmio_config) < 0)
+        return -1;
+
+    // Map whole pages covering the highest register used
+    top = mmio.data;
+    if (mmio.set > top)   top = mmio.set;
+    if (mmio.clear > top) top = mmio.clear;
+    if (mmio.input > top) top = mmio.input;
+    if (mmio.dir > top)   top = mmio.dir;
+    map_base = mmio.base & ~(page - 1);
+    mmio_map_len = ((mmio.base - map_base) + top + 4 + page - 1) & ~(page - 1);
+
+    // Only a stand-in may be created; a mistyped device path must fail
+    fd = open(mmio.device, O_RDWR | O_SYNC | (mmio.stand_in ? O_CREAT : 0), 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open mmio device %s: %s\n", mmio.device, strerror(errno));
+        return -1;
+    }
+    // Grow a stand-in file so every register exists
+    if (mmio.stand_in && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size < (off_t)(map_base + mmio_map_len) &&
+        ftruncate(fd, map_base + mmio_map_len) < 0) {
+        perror("Unable to size mmio file");
+        close(fd);
+        return -1;
+    }
+    mmio_map = mmap(NULL, mmio_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map_base);
+    close(fd);
+    if (mmio_map == MAP_FAILED) {
+        perror("Unable to map GPIO registers");
+        mmio_map = NULL;
+        return -1;
+    }
+    mmio_regs = (volatile uint32_t *)((char *)mmio_map + (mmio.base - map_base));
+
+    // Idle high, then switch all three lines to output
+    mmio_set_lines(LINE_BIT(LINE_STB) | LINE_BIT(LINE_DIO) | LINE_BIT(LINE_CLK), ~0u);
+    if (mmio.dir_out)
+        mmio_write(mmio.dir, mmio_read(mmio.dir) | mmio_bank_bits(~0u));
+    else
+        mmio_write(mmio.dir, mmio_read(mmio.dir) & ~mmio_bank_bits(~0u));
+    return 0;
+}
+
+static void mmio_send_byte(unsigned char data) {
     for (int i = 0; i < 8; i++) {
-        gpio_write(GPIO_CLK, 0);
-        delay_us(5);
-        gpio_write(GPIO_DIO, (data >> i) & 0x01);
-        delay_us(5);
-        gpio_write(GPIO_CLK, 1);
-        delay_us(5);
+        mmio_set_lines(LINE_BIT(LINE_CLK) | LINE_BIT(LINE_DIO),
+                       ((data >> i) & 0x01) ? LINE_BIT(LINE_DIO) : 0);
+        spin_ns(mmio.half_period_ns);
+        mmio_set_lines(LINE_BIT(LINE_CLK), LINE_BIT(LINE_CLK));
+        spin_ns(mmio.half_period_ns);
     }
 }
 
+static unsigned char mmio_read_byte(void) {
+    uint32_t dio = mmio_bank_bits(LINE_BIT(LINE_DIO));
+    unsigned char byte = 0;
+
+    for (int i = 0; i < 8; i++) {
+        mmio_set_lines(LINE_BIT(LINE_CLK), 0);
+        spin_ns(mmio.half_period_ns);
+        mmio_set_lines(LINE_BIT(LINE_CLK), LINE_BIT(LINE_CLK));
+        if (mmio_read(mmio.input) & dio)
+            byte |= 1u << i;
+        spin_ns(mmio.half_period_ns);
+    }
+    return byte;
+}
+
+static void mmio_strobe(int value) {
+    mmio_set_lines(LINE_BIT(LINE_STB), value ? LINE_BIT(LINE_STB) : 0);
+    spin_ns(2 * mmio.half_period_ns);
+}
+
+static void mmio_dio_input(int input) {
+    uint32_t dio = mmio_bank_bits(LINE_BIT(LINE_DIO));
+    int want = input ? !mmio.dir_out : mmio.dir_out;
+
+    if (want)
+        mmio_write(mmio.dir, mmio_read(mmio.dir) | dio);
+    else
+        mmio_write(mmio.dir, mmio_read(mmio.dir) & ~dio);
+    spin_ns(2 * mmio.half_period_ns);
+}
+
+static void mmio_close(void) {
+    if (mmio_map)
+        munmap(mmio_map, mmio_map_len);
+    mmio_map = NULL;
+    mmio_regs = NULL;
+}
+
+static const struct tm1628_backend mmio_backend = {
+    .name = "mmio",
+    .open = mmio_open,
+    .send_byte = mmio_send_byte,
+    .read_byte = mmio_read_byte,
+    .strobe = mmio_strobe,
+    .dio_input = mmio_dio_input,
+    .close = mmio_close,
+};
+
+static const struct tm1628_backend *backends[] = {
+#ifndef NO_LIBGPIOD
+    &gpiod_backend,
+#endif
+    &sysfs_backend,
+    &mmio_backend,
+};
+#define NUM_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+static const struct tm1628_backend *find_backend(const char *name) {
+    for (size_t i = 0; i < NUM_BACKENDS; i++) {
+        if (strcmp(backends[i]->name, name) == 0)
+            return backends[i];
+    }
+    return NULL;
+}
+
+void tm1628_send_byte(unsigned char data) {
+    bus->send_byte(data);
+}
+
+void tm1628_strobe(int value) {
+    bus->strobe(value);
+}
+
 // Send a command to TM1628
 void tm1628_send_command(unsigned char command) {
-    gpio_write(GPIO_STB, 0);
-    delay_us(5);
+    tm1628_strobe(0);
     tm1628_send_byte(command);
-    delay_us(5);
-    gpio_write(GPIO_STB, 1);
-    delay_us(5);
+    tm1628_strobe(1);
 }
 
 // Set brightness by sending display control command
@@ -90,26 +738,21 @@ void tm1628_send_command(unsigned char command) {
  }
 
 // TM1628 initialization sequence
-void tm1628_init() {
-    // Export and configure GPIO pins
-    gpio_export(GPIO_STB);
-    gpio_export(GPIO_CLK);
-    gpio_export(GPIO_DIO);
-    
-    gpio_set_direction(GPIO_STB, "out");
-    gpio_set_direction(GPIO_CLK, "out");
-    gpio_set_direction(GPIO_DIO, "out");
-    
+int tm1628_init(void) {
+    // Acquire and configure the bus lines
+    if (bus->open(&config) < 0)
+        return -1;
+
     // 1. Set display mode (6 grids x 11 segments; command 0x02 as per datasheet)
     tm1628_send_command(0x02);
-    
+
     // 2. Data command: auto-increment mode (0x40)
     tm1628_send_command(0x40);
-    
+
     // 3. Display control: turn on display with maximum brightness (0x8F)
     //tm1628_send_command(0x8F);
     tm1628_set_brightness(10); // Set brightness (15 = maximum). Adjust as needed.
-
+    return 0;
 }
 
 // Segment map for digits 0-9 (common cathode)
@@ -127,19 +770,33 @@ const unsigned char digit_map[10] = {
     0x6F  // 9
 };
 
-// Grid addresses for 6 grids
-const unsigned char grid_addresses[6] = {0xC0, 0xC2, 0xC4, 0xC6, 0xC8, 0xCA};
+// Display RAM used in 6x11 mode: two bytes per grid, SEG1-SEG8 then SEG9-SEG14
+#define RAM_BYTES 12
 
-// Display a pattern on all 6 grids; pattern is an array of 6 bytes (one per grid)
-void tm1628_display_pattern(const unsigned char pattern[6]) {
-    gpio_write(GPIO_STB, 0);
-    delay_us(5);
+// Write the display RAM in one auto-increment burst from address 0
+void tm1628_write_ram(const unsigned char ram[RAM_BYTES]) {
+    tm1628_send_command(0x40);
+    tm1628_strobe(0);
+    tm1628_send_byte(0xC0);
+    for (int i = 0; i < RAM_BYTES; i++)
+        tm1628_send_byte(ram[i]);
+    tm1628_strobe(1);
+}
+
+// Spread one pattern byte per grid over the RAM; SEG9-SEG14 are left blank
+static void pattern_to_ram(const unsigned char pattern[6], unsigned char ram[RAM_BYTES]) {
     for (int i = 0; i < 6; i++) {
-        tm1628_send_byte(grid_addresses[i]);
-        tm1628_send_byte(pattern[i]);
+        ram[2 * i] = pattern[i];
+        ram[2 * i + 1] = 0x00;
     }
-    gpio_write(GPIO_STB, 1);
-    delay_us(5);
+}
+
+// Display a pattern on all 6 grids; pattern is an array of 6 bytes (one per grid).
+void tm1628_display_pattern(const unsigned char pattern[6]) {
+    unsigned char ram[RAM_BYTES];
+
+    pattern_to_ram(pattern, ram);
+    tm1628_write_ram(ram);
 }
 
 // Display a repeated digit on all grids with dp turned on (e.g. 1.1.1.1.1.1)
@@ -152,16 +809,14 @@ void display_repeated_dp(unsigned char digit) {
     tm1628_display_pattern(pattern);
 }
 
-// Display the current time in HHMMSS format with dp on grid1 and grid3 to form "HH.MM.SS"
-void display_time() {
-    time_t now = time(NULL);
+// Render a wall-clock time as HHMMSS with dp on grid1 and grid3 to form "HH.MM.SS"
+static void time_pattern(time_t now, unsigned char pattern[6]) {
     struct tm *tm_info = localtime(&now);
-    
+
     int hour = tm_info->tm_hour;
     int min  = tm_info->tm_min;
     int sec  = tm_info->tm_sec;
-    
-    unsigned char pattern[6];
+
     // Grid0: hour tens (no dp)
     pattern[0] = digit_map[hour / 10];
     // Grid1: hour ones (dp ON)
@@ -174,29 +829,608 @@ void display_time() {
     pattern[4] = digit_map[sec / 10];
     // Grid5: second ones (no dp)
     pattern[5] = digit_map[sec % 10];
-    
+}
+
+// Display the current time in HHMMSS format with dp on grid1 and grid3 to form "HH.MM.SS"
+void display_time() {
+    unsigned char pattern[6];
+
+    time_pattern(time(NULL), pattern);
     tm1628_display_pattern(pattern);
 }
 
-int main() {
-    printf("Initializing TM1628...\n");
-    tm1628_init();
+// Read the 5 key scan bytes (command 0x42)
+void tm1628_read_keys(unsigned char key_data[5]) {
+    tm1628_strobe(0);
+    tm1628_send_byte(0x42);
+    bus->dio_input(1);
+    for (int i = 0; i < 5; i++)
+        key_data[i] = bus->read_byte();
+    bus->dio_input(0);
+    tm1628_strobe(1);
+}
+
+// Print the key bytes whenever they change
+static void watch_keys(void) {
+    unsigned char keys[5], last[5] = { 0 };
+
+    while (1) {
+        tm1628_read_keys(keys);
+        if (memcmp(keys, last, sizeof(keys)) != 0) {
+            printf("keys: %02X %02X %02X %02X %02X\n",
+                   keys[0], keys[1], keys[2], keys[3], keys[4]);
+            memcpy(last, keys, sizeof(keys));
+        }
+        usleep(20000);
+    }
+}
+
+static double elapsed_s(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Push frames through one backend and return frames per second
+static double bench_backend(const struct tm1628_backend *b, int frames) {
+    struct timespec start, end;
+    double secs;
+
+    bus = b;
+    if (tm1628_init() < 0)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int f = 0; f < frames; f++)
+        display_repeated_dp(f % 10);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bus->close();
+
+    secs = elapsed_s(&start, &end);
+    return secs > 0 ? frames / secs : 0;
+}
+
+// Run the benchmark on every backend (or just -b) and compare to sysfs,
+// which is measured first
+static int run_benchmark(int frames) {
+    const struct tm1628_backend *order[NUM_BACKENDS];
+    double sysfs_fps = 0;
+    size_t n = 0;
+
+    order[n++] = &sysfs_backend;
+    for (size_t i = 0; i < NUM_BACKENDS; i++) {
+        if (backends[i] != &sysfs_backend)
+            order[n++] = backends[i];
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const struct tm1628_backend *b = order[i];
+        double fps;
+
+        if (config.backend && strcmp(config.backend, b->name) != 0)
+            continue;
+        if (b == &mmio_backend && !config.mmio_config)
+            continue;
+        fps = bench_backend(b, frames);
+        if (fps < 0) {
+            fprintf(stderr, "%s: backend unavailable\n", b->name);
+            continue;
+        }
+        if (b == &sysfs_backend)
+            sysfs_fps = fps;
+        printf("backend=%s frames=%d delay_us=%d fps=%.1f", b->name, frames, config.delay, fps);
+        if (sysfs_fps > 0 && b != &sysfs_backend)
+            printf(" speedup=%.1fx", fps / sysfs_fps);
+        printf("\n");
+    }
+    return 0;
+}
+
+// --- daemon: one owner of the bus, shared over a Unix-domain socket ---
+//
+// Clients connect to the socket (-D) and send newline-terminated commands:
+//   text STRING        left-aligned text, '.' lights the previous grid's dp
+//   num VALUE [DEC]    fixed-point VALUE / 10^DEC, right-aligned
+//   raw HEX...         6 bytes (one per grid) or 12 bytes of display RAM
+//   bright LEVEL       brightness 0-15, as tm1628_set_brightness()
+//   clock              go back to the wall-clock time
+// Each command is answered with "ok" or "err <reason>". Frames are only
+// committed on the tick timer, which is aligned to wall-clock seconds, so
+// a burst of writes from any number of clients costs one bus frame per
+// tick: the newest one.
+
+#define MAX_CLIENTS 16
+#define LINE_MAX_LEN 256
+
+// Seven-segment glyphs beyond the digits; letters use whichever case has
+// the more readable shape
+static const struct {
+    char c;
+    unsigned char seg;
+} font[] = {
+    { 'A', 0x77 }, { 'B', 0x7C }, { 'C', 0x39 }, { 'D', 0x5E }, { 'E', 0x79 },
+    { 'F', 0x71 }, { 'G', 0x3D }, { 'H', 0x76 }, { 'I', 0x06 }, { 'J', 0x1E },
+    { 'L', 0x38 }, { 'N', 0x54 }, { 'O', 0x3F }, { 'P', 0x73 }, { 'Q', 0x67 },
+    { 'R', 0x50 }, { 'S', 0x6D }, { 'T', 0x78 }, { 'U', 0x3E }, { 'Y', 0x6E },
+    { '-', 0x40 }, { '_', 0x08 }, { '=', 0x48 }, { ' ', 0x00 },
+};
+
+static unsigned char glyph(char c) {
+    if (c >= '0' && c <= '9')
+        return digit_map[c - '0'];
+    c = toupper((unsigned char)c);
+    for (size_t i = 0; i < sizeof(font) / sizeof(font[0]); i++) {
+        if (font[i].c == c)
+            return font[i].seg;
+    }
+    return 0x00;
+}
+
+// Left-aligned text; a '.' goes onto the grid before it unless that one
+// already has its dp lit
+static int render_text(const char *str, unsigned char pattern[6]) {
+    int g = 0;
+
+    memset(pattern, 0, 6);
+    for (; *str; str++) {
+        if (*str == '.' && g > 0 && !(pattern[g - 1] & 0x80)) {
+            pattern[g - 1] |= 0x80;
+            continue;
+        }
+        if (g == 6)
+            return -1;
+        pattern[g++] = *str == '.' ? 0x80 : glyph(*str);
+    }
+    return 0;
+}
+
+// Right-aligned fixed-point number, zeros shown down to the units digit;
+// dashes when it does not fit
+static void render_number(long long value, int decimals, unsigned char pattern[6]) {
+    unsigned long long mag = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    int neg = value < 0;
+    int digits = 0;
+
+    for (unsigned long long m = mag; m; m /= 10)
+        digits++;
+    if (digits < decimals + 1)
+        digits = decimals + 1;
+    if (digits + neg > 6) {
+        memset(pattern, 0x40, 6);
+        return;
+    }
+
+    memset(pattern, 0, 6);
+    for (int i = 0; i < digits; i++, mag /= 10) {
+        pattern[5 - i] = digit_map[mag % 10];
+        if (decimals > 0 && i == decimals)
+            pattern[5 - i] |= 0x80;
+    }
+    if (neg)
+        pattern[5 - digits] = 0x40;
+}
+
+struct client {
+    int fd;
+    size_t len;
+    char line[LINE_MAX_LEN];
+};
+
+static struct {
+    int epfd;
+    int listen_fd;
+    int timer_fd;
+    int signal_fd;
+    struct client clients[MAX_CLIENTS];
+    int clock;                         // showing the time, not a client frame
+    int pending;                       // frame waits for the next tick
+    unsigned char frame[RAM_BYTES];    // newest frame posted
+    unsigned char shown[RAM_BYTES];    // what the chip holds
+    int shown_valid;
+    int brightness;                    // level to set on the next tick, -1 = none
+    unsigned long ticks, frames, coalesced;
+} daemon_state;
+
+// Post a frame; one that was still waiting for its tick is replaced
+static void daemon_post(const unsigned char ram[RAM_BYTES]) {
+    if (daemon_state.pending)
+        daemon_state.coalesced++;
+    memcpy(daemon_state.frame, ram, RAM_BYTES);
+    daemon_state.pending = 1;
+}
+
+static void daemon_post_pattern(const unsigned char pattern[6]) {
+    unsigned char ram[RAM_BYTES];
+
+    pattern_to_ram(pattern, ram);
+    daemon_post(ram);
+}
+
+static int parse_hex_bytes(const char *arg, unsigned char *out, int max) {
+    int n = 0;
+    unsigned int b;
+    int used;
+
+    while (sscanf(arg, " %2x%n", &b, &used) == 1) {
+        if (n == max)
+            return -1;
+        out[n++] = b;
+        arg += used;
+    }
+    while (*arg == ' ' || *arg == '\t')
+        arg++;
+    return *arg ? -1 : n;
+}
+
+// Run one command line; returns NULL on success or the error text
+static const char *daemon_command(char *line) {
+    unsigned char pattern[6], ram[RAM_BYTES];
+    char *arg = strchr(line, ' ');
+    long long value;
+    int level, decimals = 0, n;
+    char extra;
+
+    if (arg)
+        *arg++ = '\0';
+    else
+        arg = "";
+
+    if (strcmp(line, "text") == 0) {
+        if (render_text(arg, pattern) < 0)
+            return "text too long";
+        daemon_state.clock = 0;
+        daemon_post_pattern(pattern);
+    } else if (strcmp(line, "num") == 0) {
+        n = sscanf(arg, "%lld %d %c", &value, &decimals, &extra);
+        if (n < 1 || n > 2 || decimals < 0 || decimals > 5)
+            return "usage: num VALUE [DECIMALS]";
+        render_number(value, decimals, pattern);
+        daemon_state.clock = 0;
+        daemon_post_pattern(pattern);
+    } else if (strcmp(line, "raw") == 0) {
+        n = parse_hex_bytes(arg, ram, RAM_BYTES);
+        if (n == 6) {
+            memcpy(pattern, ram, 6);
+            pattern_to_ram(pattern, ram);
+        } else if (n != RAM_BYTES) {
+            return "raw takes 6 or 12 hex bytes";
+        }
+        daemon_state.clock = 0;
+        daemon_post(ram);
+    } else if (strcmp(line, "bright") == 0) {
+        if (sscanf(arg, "%d %c", &level, &extra) != 1 || level < 0 || level > 15)
+            return "usage: bright 0-15";
+        daemon_state.brightness = level;
+    } else if (strcmp(line, "clock") == 0) {
+        daemon_state.clock = 1;
+        daemon_state.pending = 0;
+    } else {
+        return "unknown command";
+    }
+    return NULL;
+}
+
+static void client_close(struct client *c) {
+    epoll_ctl(daemon_state.epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+}
+
+static void client_reply(struct client *c, const char *err) {
+    char reply[LINE_MAX_LEN];
+    int len = err ? snprintf(reply, sizeof(reply), "err %s\n", err)
+                  : snprintf(reply, sizeof(reply), "ok\n");
+
+    // Replies are short; a client that stops reading just loses them
+    send(c->fd, reply, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+// Read what the client sent and run every complete line
+static void client_input(struct client *c) {
+    ssize_t n = recv(c->fd, c->line + c->len, sizeof(c->line) - c->len, MSG_DONTWAIT);
+    char *start, *nl;
+
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (n <= 0) {
+        client_close(c);
+        return;
+    }
+    c->len += n;
+
+    start = c->line;
+    while ((nl = memchr(start, '\n', c->line + c->len - start)) != NULL) {
+        *nl = '\0';
+        if (nl > start && nl[-1] == '\r')
+            nl[-1] = '\0';
+        if (*start)
+            client_reply(c, daemon_command(start));
+        start = nl + 1;
+    }
+    c->len -= start - c->line;
+    memmove(c->line, start, c->len);
+    if (c->len == sizeof(c->line)) {
+        client_reply(c, "line too long");
+        c->len = 0;
+    }
+}
+
+static void client_accept(void) {
+    int fd = accept4(daemon_state.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN };
+
+    if (fd < 0)
+        return;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        struct client *c = &daemon_state.clients[i];
+
+        if (c->fd >= 0)
+            continue;
+        c->fd = fd;
+        c->len = 0;
+        ev.data.ptr = c;
+        if (epoll_ctl(daemon_state.epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            client_close(c);
+        return;
+    }
+    send(fd, "err too many clients\n", 21, MSG_DONTWAIT | MSG_NOSIGNAL);
+    close(fd);
+}
+
+// Fire at every whole wall-clock second and rate - 1 times in between. The
+// timer is cancelled when the clock is set, so it can be re-aligned.
+static int tick_arm(int rate) {
+    struct itimerspec its = { 0 };
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    its.it_value.tv_sec = now.tv_sec + 1;
+    if (rate == 1)
+        its.it_interval.tv_sec = 1;
+    else
+        its.it_interval.tv_nsec = 1000000000L / rate;
+    return timerfd_settime(daemon_state.timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                           &its, NULL);
+}
+
+// Commit whatever the tick has: brightness, then the newest frame, and
+// nothing at all when the chip already shows it
+static void daemon_tick(void) {
+    unsigned char pattern[6];
+
+    daemon_state.ticks++;
+    if (daemon_state.clock) {
+        time_pattern(time(NULL), pattern);
+        daemon_post_pattern(pattern);
+    }
+    if (daemon_state.brightness >= 0) {
+        tm1628_set_brightness(daemon_state.brightness);
+        daemon_state.brightness = -1;
+    }
+    if (!daemon_state.pending)
+        return;
+    daemon_state.pending = 0;
+    if (daemon_state.shown_valid &&
+        memcmp(daemon_state.shown, daemon_state.frame, RAM_BYTES) == 0)
+        return;
+    tm1628_write_ram(daemon_state.frame);
+    memcpy(daemon_state.shown, daemon_state.frame, RAM_BYTES);
+    daemon_state.shown_valid = 1;
+    daemon_state.frames++;
+}
+
+static int daemon_add_fd(int fd, void *ptr) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = ptr };
+
+    return epoll_ctl(daemon_state.epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int daemon_setup(const char *path, int rate) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    sigset_t mask;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    for (int i = 0; i < MAX_CLIENTS; i++)
+        daemon_state.clients[i].fd = -1;
+    daemon_state.clock = 1;
+    daemon_state.brightness = -1;
+
+    // SIGINT/SIGTERM end the loop through the signalfd
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    daemon_state.epfd = epoll_create1(EPOLL_CLOEXEC);
+    daemon_state.signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    daemon_state.timer_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+    daemon_state.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (daemon_state.epfd < 0 || daemon_state.signal_fd < 0 ||
+        daemon_state.timer_fd < 0 || daemon_state.listen_fd < 0) {
+        perror("daemon setup");
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(daemon_state.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(daemon_state.listen_fd, MAX_CLIENTS) < 0) {
+        perror(path);
+        return -1;
+    }
+    if (tick_arm(rate) < 0) {
+        perror("timerfd_settime");
+        return -1;
+    }
+    if (daemon_add_fd(daemon_state.listen_fd, &daemon_state.listen_fd) < 0 ||
+        daemon_add_fd(daemon_state.timer_fd, &daemon_state.timer_fd) < 0 ||
+        daemon_add_fd(daemon_state.signal_fd, &daemon_state.signal_fd) < 0) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+// Serve clients until SIGINT/SIGTERM
+static int run_daemon(const char *path, int rate) {
+    struct epoll_event events[MAX_CLIENTS + 3];
+    int running = 1;
+
+    if (daemon_setup(path, rate) < 0)
+        return 1;
+    printf("Serving %s, %d ticks/s\n", path, rate);
+
+    while (running) {
+        int n = epoll_wait(daemon_state.epfd, events, sizeof(events) / sizeof(events[0]), -1);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            uint64_t expirations;
+            struct signalfd_siginfo si;
+
+            if (ptr == &daemon_state.listen_fd) {
+                client_accept();
+            } else if (ptr == &daemon_state.timer_fd) {
+                if (read(daemon_state.timer_fd, &expirations, sizeof(expirations)) < 0) {
+                    // Clock was set: re-align and redraw the time at once
+                    if (errno != ECANCELED)
+                        continue;
+                    tick_arm(rate);
+                }
+                daemon_tick();
+            } else if (ptr == &daemon_state.signal_fd) {
+                if (read(daemon_state.signal_fd, &si, sizeof(si)) == sizeof(si))
+                    running = 0;
+            } else {
+                client_input(ptr);
+            }
+        }
+    }
+
+    printf("ticks=%lu frames=%lu coalesced=%lu\n",
+           daemon_state.ticks, daemon_state.frames, daemon_state.coalesced);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (daemon_state.clients[i].fd >= 0)
+            client_close(&daemon_state.clients[i]);
+    }
+    close(daemon_state.listen_fd);
+    unlink(path);
+    bus->close();
+    return 0;
+}
+
+// Parse "a,b,c" into three unsigned integers
+static int parse_triplet(const char *arg, int out[NUM_LINES]) {
+    return sscanf(arg, "%d,%d,%d", &out[0], &out[1], &out[2]) == NUM_LINES ? 0 : -1;
+}
+
+static int parse_args(int argc, char *argv[]) {
+    int opt, vals[NUM_LINES];
+    char *names;
+
+    while ((opt = getopt(argc, argv, "b:c:o:n:g:m:d:B:kD:r:")) != -1) {
+        switch (opt) {
+        case 'b':
+            config.backend = optarg;
+            if (!find_backend(optarg)) {
+                fprintf(stderr, "Unknown backend '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case 'c':
+            config.chip = optarg;
+            break;
+        case 'o':
+            if (parse_triplet(optarg, vals) < 0)
+                return -1;
+            for (int l = 0; l < NUM_LINES; l++)
+                config.offsets[l] = vals[l];
+            break;
+        case 'n':
+            names = strdup(optarg);
+            for (int l = 0; l < NUM_LINES; l++)
+                config.names[l] = strsep(&names, ",");
+            if (!config.names[NUM_LINES - 1])
+                return -1;
+            break;
+        case 'g':
+            if (parse_triplet(optarg, config.gpios) < 0)
+                return -1;
+            break;
+        case 'm':
+            config.mmio_config = optarg;
+            break;
+        case 'd':
+            config.delay = atoi(optarg);
+            break;
+        case 'k':
+            config.keys = 1;
+            break;
+        case 'B':
+            config.bench_frames = atoi(optarg);
+            break;
+        case 'D':
+            config.socket_path = optarg;
+            break;
+        case 'r':
+            config.rate = atoi(optarg);
+            if (config.rate < 1 || config.rate > 1000) {
+                fprintf(stderr, "Tick rate must be 1-1000\n");
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (parse_args(argc, argv) < 0) {
+        fprintf(stderr, "Usage: %s [-b sysfs|gpiod|mmio] [-c chip] [-o stb,dio,clk] "
+                "[-n stb,dio,clk] [-g stb,dio,clk] [-m mmio.conf] [-d delay_us] "
+                "[-B frames] [-k] [-D socket] [-r ticks]\n", argv[0]);
+        return 1;
+    }
+
+    if (config.bench_frames > 0)
+        return run_benchmark(config.bench_frames);
+
+    bus = config.backend ? find_backend(config.backend) : backends[0];
+
+    printf("Initializing TM1628 (%s)...\n", bus->name);
+    if (tm1628_init() < 0)
+        return 1;
+
+    if (config.keys) {
+        watch_keys();
+        return 0;
+    }
+    if (config.socket_path)
+        return run_daemon(config.socket_path, config.rate);
     delay_us(1000000);
-    
+
     // Display repeated patterns for digits 0-9 with dp (only one display per digit)
     for (unsigned char d = 0; d <= 9; d++) {
         printf("Displaying '%d.%d.%d.%d.%d.%d' on the LED grid (with dp)...\n", d, d, d, d, d, d);
         display_repeated_dp(d);
         sleep(1);
     }
-    
+
     // Continuously display the current time in HHMMSS format with dp on grid1 and grid3
     printf("Displaying current time (HH.MM.SS) on the LED grid...\n");
     while (1) {
         display_time();
         sleep(1);
     }
-    
+
     return 0;
 }
-